@@ -0,0 +1,307 @@
+#pragma once
+// Ассоциативный массив ключ-значение на основе AVLTree.
+// Вставка O(log2(n))
+// Поиск O(log2(n))
+// Удаление O(log2(n))
+#include "AVLTreeLegacy.h"
+#include <string>
+#include <string_view>
+
+// Компаратор пар (ключ, значение) по ключу. Всегда прозрачный: сравнивает пары между собой и
+// пары с ключами любого типа, который понимает Compare. Трехстороннее сравнение делегируется Compare.
+template<typename K, typename V, typename Compare>
+class MapKeyCompare {
+public:
+    using is_transparent = void;
+    using Pair = std::pair<const K, V>;
+
+    MapKeyCompare(const Compare& n_comp = Compare()) : comp(n_comp) {}
+
+    bool operator()(const Pair& a, const Pair& b) const {
+        return comp(a.first, b.first);
+    }
+
+    template<typename Key>
+    bool operator()(const Pair& a, const Key& b) const {
+        return comp(a.first, b);
+    }
+
+    template<typename Key>
+    bool operator()(const Key& a, const Pair& b) const {
+        return comp(a, b.first);
+    }
+
+    template<typename A, typename B>
+    int three_way(const A& a, const B& b) const {
+        return threeWayCompare(comp, keyOf(a), keyOf(b));
+    }
+
+    // Компаратор ключей
+    Compare comp;
+
+private:
+    static const K& keyOf(const Pair& pair) {
+        return pair.first;
+    }
+
+    template<typename Key>
+    static const Key& keyOf(const Key& key) {
+        return key;
+    }
+};
+
+// Класс AVLMap хранит пары (ключ, значение) с уникальными ключами, упорядоченные по Compare.
+// Если Compare прозрачный (например std::less<>), поиск, удаление и границы принимают ключи
+// другого типа: AVLMap<std::string, V, std::less<>> ищется по std::string_view без временной строки.
+template<typename K, typename V, typename Compare = std::less<K>, typename Alloc = std::allocator<std::pair<const K, V>>>
+class AVLMap {
+public:
+    using value_type = std::pair<const K, V>;
+    using Tree = AVLTree<value_type, Alloc, MapKeyCompare<K, V, Compare>>;
+    using Iterator = typename Tree::Iterator;
+    using ReverseIterator = typename Tree::ReverseIterator;
+
+    // Конструктор по умолчанию.
+    AVLMap(const Compare& compare = Compare(), const Alloc& alloc = Alloc()) : tree(MapKeyCompare<K, V, Compare>(compare), alloc) {}
+
+    // Число пар. O(1)
+    size_t size() const {
+        return tree.size();
+    }
+
+    // Проверка на пустоту. O(1)
+    bool isEmpty() const {
+        return tree.isEmpty();
+    }
+
+    // Удаление всех пар.
+    void clear() {
+        tree.clear();
+    }
+
+    Iterator begin() const {
+        return tree.begin();
+    }
+
+    Iterator end() const {
+        return tree.end();
+    }
+
+    ReverseIterator rbegin() const {
+        return tree.rbegin();
+    }
+
+    ReverseIterator rend() const {
+        return tree.rend();
+    }
+
+    // Вставка пары, если ключа еще нет. Возвращает итератор на пару с этим ключом и признак вставки. Log2N | Log2N | 1
+    std::pair<Iterator, bool> insert(const value_type& value) {
+        return wrap(tree.insertUnique(value.first, value));
+    }
+
+    std::pair<Iterator, bool> insert(value_type&& value) {
+        return wrap(tree.insertUnique(value.first, std::move(value)));
+    }
+
+    // Вставка пары (key, V(args...)), если ключа еще нет. Если ключ есть, args не используются
+    // (не копируются и не перемещаются). Log2N | Log2N | 1
+    template<typename... Args>
+    std::pair<Iterator, bool> try_emplace(const K& key, Args&&... args) {
+        return wrap(tree.insertUnique(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+
+    template<typename... Args>
+    std::pair<Iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return wrap(tree.insertUnique(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+
+    // Вставка пары или замена значения существующего ключа. Log2N | Log2N | 1
+    template<typename M>
+    std::pair<Iterator, bool> insert_or_assign(const K& key, M&& value) {
+        std::pair<Iterator, bool> result = try_emplace(key, std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    template<typename M>
+    std::pair<Iterator, bool> insert_or_assign(K&& key, M&& value) {
+        std::pair<Iterator, bool> result = try_emplace(std::move(key), std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    // Доступ к значению по ключу; отсутствующий ключ вставляется со значением V(). Log2N | Log2N | 1
+    V& operator[](const K& key) {
+        return try_emplace(key).first->second;
+    }
+
+    V& operator[](K&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    // Доступ к значению по ключу. Бросает исключение, если ключа нет. Log2N | Log2N | 1
+    V& at(const K& key) {
+        return atKey(key);
+    }
+
+    const V& at(const K& key) const {
+        return atKey(key);
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    V& at(const Key& key) {
+        return atKey(key);
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    const V& at(const Key& key) const {
+        return atKey(key);
+    }
+
+    // Итератор на пару с ключом key или end(). Log2N | Log2N | 1
+    Iterator find(const K& key) const {
+        return tree.iteratorAt(tree.findNodeKey(key));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    Iterator find(const Key& key) const {
+        return tree.iteratorAt(tree.findNodeKey(key));
+    }
+
+    // Есть ли ключ key. Log2N | Log2N | 1
+    bool contains(const K& key) const {
+        return tree.findNodeKey(key) != nullptr;
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    bool contains(const Key& key) const {
+        return tree.findNodeKey(key) != nullptr;
+    }
+
+    // Число пар с ключом key (0 или 1). Log2N | Log2N | 1
+    size_t count(const K& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    size_t count(const Key& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    // Удаление пары с ключом key. Возвращает число удаленных пар (0 или 1). Log2N | Log2N | 1
+    size_t erase(const K& key) {
+        return tree.removeKey(key) ? 1 : 0;
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    size_t erase(const Key& key) {
+        return tree.removeKey(key) ? 1 : 0;
+    }
+
+    // Первая пара с ключом, не меньшим key. Log2N | Log2N | 1
+    Iterator lower_bound(const K& key) const {
+        return tree.iteratorAt(tree.boundNode(key, false));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    Iterator lower_bound(const Key& key) const {
+        return tree.iteratorAt(tree.boundNode(key, false));
+    }
+
+    // Первая пара с ключом, большим key. Log2N | Log2N | 1
+    Iterator upper_bound(const K& key) const {
+        return tree.iteratorAt(tree.boundNode(key, true));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    Iterator upper_bound(const Key& key) const {
+        return tree.iteratorAt(tree.boundNode(key, true));
+    }
+
+    // Проверка балансировки и связей дерева (для тестов). N | N | N
+    bool checkInvariants() const {
+        return tree.checkHeights() && tree.checkParents();
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        AVLMap<int, std::string> map;
+        assert(map.isEmpty());
+        map[5] = "five";
+        map[1] = "one";
+        map[3];
+        assert(map.size() == 3 && map.at(3).empty());
+
+        // try_emplace не трогает аргументы, если ключ уже есть
+        std::string payload = "payload";
+        assert(!map.try_emplace(5, std::move(payload)).second);
+        assert(payload == "payload" && map.at(5) == "five");
+        assert(map.try_emplace(7, std::move(payload)).second);
+        assert(map.at(7) == "payload");
+
+        assert(!map.insert_or_assign(1, "uno").second && map.at(1) == "uno");
+        assert(map.insert_or_assign(9, "nine").second && map.at(9) == "nine");
+        assert(!map.insert(std::make_pair(9, std::string("nueve"))).second && map[9] == "nine");
+
+        vector<int> keys;
+        for (const auto& pair : map) {
+            keys.push_back(pair.first);
+        }
+        assert(keys == vector<int>({ 1, 3, 5, 7, 9 }));
+        assert(map.lower_bound(4)->first == 5 && map.upper_bound(5)->first == 7);
+        assert(map.find(4) == map.end() && map.find(3) != map.end());
+
+        assert(map.erase(3) == 1 && map.erase(3) == 0);
+        assert(map.size() == 4 && !map.contains(3) && map.count(5) == 1);
+        try {
+            map.at(3);
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+        assert(map.checkInvariants());
+
+        // Прозрачный компаратор: поиск строковых ключей по string_view и const char*
+        AVLMap<std::string, int, std::less<>> names;
+        names["delta"] = 4;
+        names["alpha"] = 1;
+        names.try_emplace("charlie", 3);
+        names.insert_or_assign("bravo", 2);
+        std::string_view view = "charlie";
+        assert(names.contains(view) && names.at(view) == 3);
+        assert(names.find("alpha")->second == 1);
+        assert(names.lower_bound(std::string_view("b"))->first == "bravo");
+        assert(names.erase(std::string_view("delta")) == 1 && names.size() == 3);
+
+        // Обратный порядок ключей
+        AVLMap<int, int, std::greater<int>> descending;
+        for (int k = 0; k < 100; k++) {
+            descending[k] = k * k;
+        }
+        assert(descending.begin()->first == 99 && descending.rbegin()->first == 0);
+        assert(descending.lower_bound(50)->first == 50 && descending.upper_bound(50)->first == 49);
+
+        std::cout << "AVLMap tests passed!" << std::endl;
+    }
+
+private:
+    Tree tree;
+
+    std::pair<Iterator, bool> wrap(std::pair<AVLTreeNode<value_type>*, bool> result) const {
+        return std::make_pair(tree.iteratorAt(result.first), result.second);
+    }
+
+    template<typename Key>
+    V& atKey(const Key& key) const {
+        AVLTreeNode<value_type>* node = tree.findNodeKey(key);
+        if (node == nullptr) {
+            throw std::out_of_range("Key not found");
+        }
+        return node->n_data.second;
+    }
+};
@@ -0,0 +1,69 @@
+﻿// AVLTreeBench.cpp : набор замеров всех операций AVLTree, BinarySearchTree и std::set.
+// Запуск: AVLTreeBench [максимальное число ключей, по умолчанию 1000000] [--all]
+// С --all после сводного набора выполняются и все специализированные замеры (как AVLTreeLegacy --bench).
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include "AVLTreeBenchmark.h"
+
+// Глобальные operator new/delete со счетчиками выделений (колонки allocs/op и bytes/key).
+// GCC не видит, что free парная к malloc из замененного operator new, и предупреждает.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    AllocationCounter::count.fetch_add(1, std::memory_order_relaxed);
+    AllocationCounter::bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char* argv[]) {
+    AllocationCounter::enabled = true;
+    // Одна строка сводного набора в отдельном процессе (ее запускает runSuite)
+    int rowResult = AVLTreeBenchmark::runSuiteRowCommand(argc, argv);
+    if (rowResult >= 0) {
+        return rowResult;
+    }
+    size_t maxKeys = 1000000;
+    bool all = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--all") == 0) {
+            all = true;
+        }
+        else {
+            maxKeys = std::stoull(argv[i]);
+        }
+    }
+    if (all) {
+        AVLTreeBenchmark::runAll(maxKeys, argv[0]);
+    }
+    else {
+        AVLTreeBenchmark::runSuite(maxKeys, argv[0]);
+    }
+    return 0;
+}
@@ -0,0 +1,1066 @@
+#pragma once
+// Замеры производительности AVL-дерева. Запуск: AVLTreeLegacy --bench [максимальное число ключей]
+// или AVLTreeBench [максимальное число ключей] [--all] (отдельная цель сборки, см. CMakeLists.txt).
+#include "AVLTreeLegacy.h"
+#include "ConcurrentAVLTree.h"
+#include "PersistentAVLTree.h"
+#include "ShardedAVLTree.h"
+#include "FlatCombiningAVLTree.h"
+#include "TreeSerialization.h"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <fstream>
+#include <set>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+// Счетчики выделений памяти для замеров. Растут, только если программа заменяет глобальный operator new
+// и включает enabled (так делает AVLTreeBench.cpp); иначе колонки выделений не выводятся.
+struct AllocationCounter {
+    static inline std::atomic<size_t> count{ 0 };
+    static inline std::atomic<size_t> bytes{ 0 };
+    static inline bool enabled = false;
+};
+
+// Генератор рангов 0..n-1 с распределением Ципфа (ранг r выпадает с вероятностью ~ 1 / (r + 1)^theta).
+// Метод Грея и др. (как в YCSB): одна сумма дзета-функции при создании, без таблицы на n элементов.
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n_items, double n_theta = 0.99) : items(n_items), theta(n_theta) {
+        zetaN = zeta(items, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / static_cast<double>(items), 1.0 - theta)) / (1.0 - zeta(2, theta) / zetaN);
+    }
+
+    template<typename Rng>
+    size_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetaN;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta)) {
+            return 1;
+        }
+        size_t rank = static_cast<size_t>(static_cast<double>(items) * std::pow(eta * u - eta + 1.0, alpha));
+        return std::min(rank, items - 1);
+    }
+
+private:
+    size_t items;
+    double theta;
+    double zetaN;
+    double alpha;
+    double eta;
+
+    static double zeta(size_t n, double theta) {
+        double sum = 0;
+        for (size_t i = 1; i <= n; i++) {
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+};
+
+class AVLTreeBenchmark {
+public:
+    // Все замеры подряд; self - см. runSuite
+    static void runAll(size_t maxKeys = 10000000, const char* self = nullptr) {
+        runSuite(maxKeys, self);
+        runScaling(maxKeys);
+        runBulkBuild(maxKeys);
+        runFrozen(maxKeys);
+        runFrozenBlocks(maxKeys);
+        runBatchLookup(maxKeys);
+        runSortedBatch(maxKeys);
+        runSetAlgebra(maxKeys);
+        runParallel(maxKeys);
+        runVisitors(maxKeys);
+        runConcurrentReads(maxKeys);
+        runSnapshots(maxKeys);
+        runShardedInserts(maxKeys);
+        runContendedUpdates(maxKeys);
+        runColdStart(maxKeys);
+        runDump(maxKeys);
+    }
+
+    // Сводный набор: все основные операции AVLTree, BinarySearchTree и std::set (нс на операцию, для bulk -
+    // на ключ) для распределений ключей sequential (по возрастанию), random (перемешанные), zipfian
+    // (вставка перемешанных, поиск по Ципфу - горячие ключи) и adversarial (возрастающие ключи в
+    // несбалансированное BinarySearchTree, до ADVERSARIAL_LIMIT ключей: дальше O(n^2)). Выделения памяти
+    // на вставку и байты на ключ - при подключенном AllocationCounter.
+    // Пиковый RSS растет за весь процесс и не убывает, поэтому его можно сравнивать, только если каждая
+    // строка замеряется в своем процессе: self - путь к программе, которая выполняет одну строку по
+    // аргументам "--suite-row ключей распределение дерево" (см. runSuiteRowCommand). Без self строки
+    // выполняются в этом процессе, а колонка peak MB не выводится.
+    static void runSuite(size_t maxKeys = 10000000, const char* self = nullptr) {
+        std::printf("%10s %-11s %-5s %9s %9s %9s %9s %9s %9s %9s %10s %9s %9s\n", "keys", "dist", "tree",
+            "insert", "find", "succ", "iterate", "traverse", "remove", "bulk", "allocs/op", "bytes/key", "peak MB");
+        const char* rows[][2] = {
+            { "sequential", "set" }, { "sequential", "avl" },
+            { "random", "set" }, { "random", "avl" }, { "random", "bst" },
+            { "zipfian", "set" }, { "zipfian", "avl" }, { "zipfian", "bst" },
+            { "adversarial", "bst" },
+        };
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            for (const auto& row : rows) {
+                if (std::strcmp(row[0], "adversarial") == 0 && n > ADVERSARIAL_LIMIT) {
+                    continue;
+                }
+                if (self == nullptr) {
+                    runSuiteRow(n, row[0], row[1], false);
+                    continue;
+                }
+                std::fflush(stdout); // Строка дочернего процесса должна выйти после уже выведенных
+                std::string command = std::string("\"") + self + "\" --suite-row " + std::to_string(n) + " " + row[0] + " " + row[1];
+                if (std::system(command.c_str()) != 0) {
+                    std::printf("error: suite row %zu %s %s failed\n", n, row[0], row[1]);
+                }
+            }
+        }
+    }
+
+    // Выполнение одной строки сводного набора по аргументам командной строки программы, если это
+    // "--suite-row ключей распределение дерево". Возвращает код завершения или -1 для других аргументов.
+    static int runSuiteRowCommand(int argc, char* argv[]) {
+        if (argc != 5 || std::strcmp(argv[1], "--suite-row") != 0) {
+            return -1;
+        }
+        return runSuiteRow(std::stoull(argv[2]), argv[3], argv[4], true) ? 0 : 1;
+    }
+
+    // Одна строка сводного набора: n ключей распределения distribution в контейнере tree (set, avl, bst).
+    // Ключи строятся заново из тех же зерен, поэтому строка в отдельном процессе замеряет то же самое.
+    static bool runSuiteRow(size_t n, const std::string& distribution, const std::string& tree, bool reportPeak) {
+        std::vector<int> sorted(n);
+        for (size_t i = 0; i < n; i++) {
+            sorted[i] = static_cast<int>(i);
+        }
+        std::vector<int> inserts = sorted;
+        std::vector<int> queries = sorted;
+        std::vector<int> removals = sorted;
+        if (distribution == "random" || distribution == "zipfian") {
+            inserts = shuffledKeys(n, 42);
+            queries = removals = shuffledKeys(n, 11);
+        }
+        else if (distribution == "adversarial") {
+            queries = shuffledKeys(n, 11);
+        }
+        else if (distribution != "sequential") {
+            return false;
+        }
+        if (distribution == "zipfian") {
+            ZipfGenerator ranks(n);
+            std::mt19937 rng(5);
+            for (size_t i = 0; i < n; i++) {
+                // Горячие ранги разбросаны по ключам (множитель взаимно прост с 10^k)
+                queries[i] = static_cast<int>(ranks(rng) * 2654435761ULL % n);
+            }
+        }
+        const char* name = distribution.c_str();
+        if (tree == "set") {
+            runSuiteRow<SetAdapter>(n, name, inserts, queries, removals, sorted, reportPeak);
+        }
+        else if (tree == "avl") {
+            runSuiteRow<AVLAdapter>(n, name, inserts, queries, removals, sorted, reportPeak);
+        }
+        else if (tree == "bst") {
+            runSuiteRow<BSTAdapter>(n, name, inserts, queries, removals, sorted, reportPeak);
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    // Наибольшее число возрастающих ключей для несбалансированного дерева: поиск в нем рекурсивный,
+    // глубина рекурсии равна числу ключей
+    static const size_t ADVERSARIAL_LIMIT = 10000;
+
+    // Масштабирование: время одной операции (нс) при росте дерева от 1K до maxKeys ключей.
+    // При хранимой высоте вставка, поиск и удаление стоят O(log2(n)), поэтому время на операцию
+    // должно расти только логарифмически, а не линейно.
+    static void runScaling(size_t maxKeys = 10000000) {
+        std::printf("%12s %14s %14s %14s %8s\n", "keys", "insert ns/op", "find ns/op", "remove ns/op", "height");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+
+            AVLTree<int> tree;
+            double insertNs = measure(n, [&] {
+                for (int key : keys) {
+                    tree.insert(key);
+                }
+            });
+
+            std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+            size_t found = 0;
+            double findNs = measure(n, [&] {
+                for (int key : keys) {
+                    found += tree.findNode(key) != nullptr;
+                }
+            });
+            int height = tree.getTreeHeight();
+
+            double removeNs = measure(n, [&] {
+                for (int key : keys) {
+                    tree.remove(key);
+                }
+            });
+
+            std::printf("%12zu %14.1f %14.1f %14.1f %8d\n", n, insertNs, findNs, removeNs, height);
+            if (found != n) {
+                std::printf("error: found %zu of %zu keys\n", found, n);
+            }
+        }
+    }
+
+    // Загрузка отсортированных ключей: вставка по одному против линейного построения assignSorted
+    static void runBulkBuild(size_t maxKeys = 10000000) {
+        std::printf("%12s %16s %16s\n", "keys", "insert loop ms", "assignSorted ms");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = static_cast<int>(i);
+            }
+
+            AVLTree<int> inserted;
+            double insertNs = measure(1, [&] {
+                for (int key : keys) {
+                    inserted.insert(key);
+                }
+            });
+            AVLTree<int> built;
+            double buildNs = measure(1, [&] {
+                built.assignSorted(keys.begin(), keys.end());
+            });
+            std::printf("%12zu %16.2f %16.2f\n", n, insertNs / 1e6, buildNs / 1e6);
+        }
+    }
+
+    // Поиск в дереве с указателями против поиска в снимке freeze() (массив в порядке Эйтцингера).
+    // Половина запросов промахивается: ищутся и четные (есть в дереве), и нечетные ключи.
+    static void runFrozen(size_t maxKeys = 10000000) {
+        std::printf("%12s %14s %14s %10s\n", "keys", "findNode ns/op", "frozen ns/op", "speedup");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = static_cast<int>(i * 2);
+            }
+            AVLTree<int> tree;
+            tree.assignSorted(keys.begin(), keys.end());
+            FrozenAVLTree<int> frozen = tree.freeze();
+            std::vector<int> queries = shuffledKeys(2 * n, 11);
+
+            size_t treeFound = 0;
+            double treeNs = measure(queries.size(), [&] {
+                for (int key : queries) {
+                    treeFound += tree.findNode(key) != nullptr;
+                }
+            });
+            size_t frozenFound = 0;
+            double frozenNs = measure(queries.size(), [&] {
+                for (int key : queries) {
+                    frozenFound += frozen.contains(key);
+                }
+            });
+            std::printf("%12zu %14.1f %14.1f %9.2fx\n", n, treeNs, frozenNs, treeNs / frozenNs);
+            if (treeFound != n || frozenFound != n) {
+                std::printf("error: found %zu and %zu of %zu keys\n", treeFound, frozenFound, n);
+            }
+        }
+    }
+
+    // Поиск в блоках freezeBlocks() для каждого набора инструкций, до которого дотягивает процессор
+    static void runFrozenBlocks(size_t maxKeys = 10000000) {
+        std::printf("%12s %14s %14s %14s\n", "keys", "scalar ns/op", "sse2 ns/op", "avx2 ns/op");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys(n);
+            for (size_t i = 0; i < n; i++) {
+                keys[i] = static_cast<int>(i * 2);
+            }
+            AVLTree<int> tree;
+            tree.assignSorted(keys.begin(), keys.end());
+            FrozenKeyBlocks<int> blocks = tree.freezeBlocks();
+            std::vector<int> queries = shuffledKeys(2 * n, 11);
+
+            std::printf("%12zu", n);
+            const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+            for (SimdLevel level : levels) {
+                if (level > detectSimdLevel()) {
+                    std::printf(" %14s", "n/a");
+                    continue;
+                }
+                blocks.setLevel(level);
+                size_t found = 0;
+                double ns = measure(queries.size(), [&] {
+                    for (int key : queries) {
+                        found += blocks.contains(key);
+                    }
+                });
+                std::printf(" %14.1f", ns);
+                if (found != n) {
+                    std::printf(" error: found %zu of %zu keys", found, n);
+                }
+            }
+            std::printf("\n");
+        }
+    }
+
+    // Пакетный поиск find_batch против цикла по findNode (половина ключей отсутствует)
+    static void runBatchLookup(size_t maxKeys = 10000000) {
+        std::printf("%12s %14s %14s %10s\n", "keys", "findNode ns/op", "batch ns/op", "speedup");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+            for (int& key : keys) {
+                key *= 2;
+            }
+            AVLTree<int> tree;
+            for (int key : keys) {
+                tree.insert(key);
+            }
+            std::vector<int> queries = shuffledKeys(2 * n, 11);
+            std::vector<AVLTreeNode<int>*> out(queries.size());
+
+            double loopNs = measure(queries.size(), [&] {
+                for (size_t i = 0; i < queries.size(); i++) {
+                    out[i] = tree.findNode(queries[i]);
+                }
+            });
+            size_t loopFound = queries.size() - std::count(out.begin(), out.end(), nullptr);
+            double batchNs = measure(queries.size(), [&] {
+                tree.find_batch(queries, out);
+            });
+            size_t batchFound = queries.size() - std::count(out.begin(), out.end(), nullptr);
+            std::printf("%12zu %14.1f %14.1f %9.2fx\n", n, loopNs, batchNs, loopNs / batchNs);
+            if (loopFound != n || batchFound != n) {
+                std::printf("error: found %zu and %zu of %zu keys\n", loopFound, batchFound, n);
+            }
+        }
+    }
+
+    // Применение отсортированных пакетов к дереву из maxKeys ключей: insert/remove по одному против
+    // insert_sorted/erase_sorted (split/join для коротких пакетов, слияние с перестройкой для длинных)
+    static void runSortedBatch(size_t maxKeys = 10000000) {
+        std::printf("%12s %12s %16s %16s %16s %16s\n", "tree keys", "batch", "insert loop ms", "insert_sorted ms", "remove loop ms", "erase_sorted ms");
+        std::vector<int> keys(maxKeys);
+        for (size_t i = 0; i < maxKeys; i++) {
+            keys[i] = static_cast<int>(i * 2);
+        }
+        for (size_t batch = 1000; batch <= maxKeys; batch *= 10) {
+            // Пакет - нечетные ключи, равномерно разбросанные по дереву
+            std::vector<int> delta(batch);
+            for (size_t i = 0; i < batch; i++) {
+                delta[i] = static_cast<int>(i * (maxKeys / batch) * 2 + 1);
+            }
+
+            AVLTree<int> looped;
+            looped.assignSorted(keys.begin(), keys.end());
+            double insertNs = measure(1, [&] {
+                for (int key : delta) {
+                    looped.insert(key);
+                }
+            });
+            double removeNs = measure(1, [&] {
+                for (int key : delta) {
+                    looped.remove(key);
+                }
+            });
+
+            AVLTree<int> merged;
+            merged.assignSorted(keys.begin(), keys.end());
+            double insertSortedNs = measure(1, [&] {
+                merged.insert_sorted(delta.begin(), delta.end());
+            });
+            double eraseSortedNs = measure(1, [&] {
+                merged.erase_sorted(delta.begin(), delta.end());
+            });
+            std::printf("%12zu %12zu %16.2f %16.2f %16.2f %16.2f\n", maxKeys, batch, insertNs / 1e6, insertSortedNs / 1e6, removeNs / 1e6, eraseSortedNs / 1e6);
+            if (merged.size() != maxKeys || looped.size() != maxKeys) {
+                std::printf("error: sizes %zu and %zu instead of %zu\n", merged.size(), looped.size(), maxKeys);
+            }
+        }
+    }
+
+    // Объединение и пересечение дерева из maxKeys ключей с деревом из m ключей: union_with/intersect_with
+    // (split/join с переиспользованием узлов) против обхода меньшего дерева со вставкой/поиском.
+    // intersect_with забирает большое дерево и освобождает все его узлы - это входит в замер.
+    static void runSetAlgebra(size_t maxKeys = 10000000) {
+        std::printf("%12s %12s %16s %16s %16s %16s\n", "tree keys", "other keys", "insert loop ms", "union_with ms", "find loop ms", "intersect ms");
+        std::vector<int> keys(maxKeys);
+        for (size_t i = 0; i < maxKeys; i++) {
+            keys[i] = static_cast<int>(i * 2);
+        }
+        for (size_t m = 1000; m <= maxKeys; m *= 10) {
+            // Половина ключей другого дерева уже есть в большом
+            std::vector<int> others(m);
+            for (size_t i = 0; i < m; i++) {
+                others[i] = static_cast<int>(i * (maxKeys / m) * 2 + (i % 2));
+            }
+
+            AVLTree<int> looped;
+            looped.assignSorted(keys.begin(), keys.end());
+            AVLTree<int> source;
+            source.assignSorted(others.begin(), others.end());
+            double insertNs = measure(1, [&] {
+                for (int key : source) {
+                    looped.insert(key);
+                }
+            });
+            AVLTree<int> kept;
+            double findNs = measure(1, [&] {
+                for (int key : source) {
+                    if (looped.findNode(key) != nullptr) {
+                        kept.insert(key);
+                    }
+                }
+            });
+
+            AVLTree<int> merged;
+            merged.assignSorted(keys.begin(), keys.end());
+            AVLTree<int> other;
+            other.assignSorted(others.begin(), others.end());
+            double unionNs = measure(1, [&] {
+                merged.union_with(std::move(other));
+            });
+            AVLTree<int> intersected;
+            intersected.assignSorted(others.begin(), others.end());
+            double intersectNs = measure(1, [&] {
+                intersected.intersect_with(std::move(merged));
+            });
+            std::printf("%12zu %12zu %16.2f %16.2f %16.2f %16.2f\n", maxKeys, m, insertNs / 1e6, unionNs / 1e6, findNs / 1e6, intersectNs / 1e6);
+            if (looped.size() != maxKeys + m / 2 || intersected.size() != m || kept.size() != m) {
+                std::printf("error: sizes %zu, %zu and %zu\n", looped.size(), intersected.size(), kept.size());
+            }
+        }
+    }
+
+    // Параллельное построение из maxKeys ключей и объединение двух деревьев по maxKeys / 2 ключей
+    // (вперемешку) на пуле из 1, 2, 4, ... потоков, до числа ядер. Ускорение - относительно одного потока.
+    static void runParallel(size_t maxKeys = 10000000) {
+        std::vector<int> keys(maxKeys);
+        std::vector<int> evens((maxKeys + 1) / 2);
+        std::vector<int> odds(maxKeys / 2);
+        for (size_t i = 0; i < maxKeys; i++) {
+            keys[i] = static_cast<int>(i);
+            (i % 2 == 0 ? evens : odds)[i / 2] = static_cast<int>(i);
+        }
+        size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::printf("%12s %8s %12s %10s %12s %10s\n", "keys", "threads", "build ms", "speedup", "union ms", "speedup");
+        double buildBase = 0;
+        double unionBase = 0;
+        for (size_t threads = 1; ; threads = std::min(threads * 2, cores)) {
+            WorkStealingPool pool(threads);
+            AVLTree<int> built;
+            double buildNs = measure(1, [&] {
+                built.assignSorted(keys.begin(), keys.end(), pool);
+            });
+            AVLTree<int> left;
+            AVLTree<int> right;
+            left.assignSorted(evens.begin(), evens.end(), pool);
+            right.assignSorted(odds.begin(), odds.end(), pool);
+            double unionNs = measure(1, [&] {
+                left.union_with(std::move(right), pool);
+            });
+            if (threads == 1) {
+                buildBase = buildNs;
+                unionBase = unionNs;
+            }
+            std::printf("%12zu %8zu %12.2f %9.2fx %12.2f %9.2fx\n", maxKeys, threads, buildNs / 1e6, buildBase / buildNs, unionNs / 1e6, unionBase / unionNs);
+            if (built.size() != maxKeys || left.size() != maxKeys) {
+                std::printf("error: sizes %zu and %zu instead of %zu\n", built.size(), left.size(), maxKeys);
+            }
+            if (threads == cores) {
+                break;
+            }
+        }
+    }
+
+    // Стоимость обхода на узел для тривиального посетителя (сумма): прежний apply с const std::function&
+    // (рекурсивный applyFunction, косвенный вызов на узел) против шаблонного итеративного apply,
+    // для BinarySearchTree и AVLTree
+    static void runVisitors(size_t maxKeys = 10000000) {
+        std::printf("%12s %18s %18s %18s %18s\n", "keys", "bst function ns", "bst template ns", "avl iterator ns", "avl template ns");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+            BinarySearchTree<int> bst;
+            for (int key : keys) {
+                bst.insert(key);
+            }
+            AVLTree<int> avl;
+            std::sort(keys.begin(), keys.end());
+            avl.assignSorted(keys.begin(), keys.end());
+
+            long long sums[4] = { 0, 0, 0, 0 };
+            const std::function<void(int&)> visit = [&](int& val) { sums[0] += val; };
+            double functionNs = measure(n, [&] {
+                bst.apply(visit);
+            });
+            double templateNs = measure(n, [&] {
+                bst.apply([&](int& val) { sums[1] += val; });
+            });
+            double iteratorNs = measure(n, [&] {
+                for (int val : avl) {
+                    sums[2] += val;
+                }
+            });
+            double avlTemplateNs = measure(n, [&] {
+                avl.apply([&](int& val) { sums[3] += val; });
+            });
+            std::printf("%12zu %18.2f %18.2f %18.2f %18.2f\n", n, functionNs, templateNs, iteratorNs, avlTemplateNs);
+            long long expected = static_cast<long long>(n) * static_cast<long long>(n - 1) / 2;
+            if (sums[0] != expected || sums[1] != expected || sums[2] != expected || sums[3] != expected) {
+                std::printf("error: wrong sums\n");
+            }
+        }
+    }
+
+    // Чтение одного дерева многими потоками при непрерывных обновлениях одним писателем: поиск без
+    // блокировок в ConcurrentAVLTree против AVLTree под std::shared_mutex (писатель берет его монопольно).
+    // Пропускная способность читателей в млн операций/с и число обновлений писателя в секунду.
+    static void runConcurrentReads(size_t maxKeys = 10000000) {
+        size_t n = std::min<size_t>(maxKeys, 1000000);
+        std::vector<int> evens(n);
+        for (size_t i = 0; i < n; i++) {
+            evens[i] = static_cast<int>(2 * i);
+        }
+        ConcurrentAVLTree<int> concurrent;
+        for (int key : shuffledKeys(n, 42)) {
+            concurrent.insert(2 * key);
+        }
+        AVLTree<int> locked;
+        locked.assignSorted(evens.begin(), evens.end());
+        std::shared_mutex lock;
+
+        std::printf("%12s %8s %16s %16s %16s %16s\n", "keys", "readers", "lock-free Mops", "writes/s", "shared_mutex Mops", "writes/s");
+        for (size_t readers = 1; readers <= 32; readers *= 2) {
+            size_t concurrentWrites = 0;
+            double concurrentOps = throughput(readers,
+                [&](int key) { return concurrent.contains(key); },
+                [&](int key) { concurrent.insert(key); concurrent.remove(key); }, n, concurrentWrites);
+            size_t lockedWrites = 0;
+            double lockedOps = throughput(readers,
+                [&](int key) { std::shared_lock<std::shared_mutex> guard(lock); return locked.findNode(key) != nullptr; },
+                [&](int key) {
+                    { std::unique_lock<std::shared_mutex> guard(lock); locked.insert(key); }
+                    { std::unique_lock<std::shared_mutex> guard(lock); locked.remove(key); }
+                }, n, lockedWrites);
+            std::printf("%12zu %8zu %16.2f %16zu %16.2f %16zu\n", n, readers, concurrentOps, concurrentWrites, lockedOps, lockedWrites);
+            if (concurrent.size() != n || locked.size() != n) {
+                std::printf("error: sizes %zu and %zu instead of %zu\n", concurrent.size(), locked.size(), n);
+            }
+        }
+    }
+
+    // Снимки для отчетов: O(1) snapshot персистентного дерева против полной копии AVLTree, и цена
+    // изменений, когда каждая запись идет после нового снимка (копирование пути) и когда снимков нет.
+    static void runSnapshots(size_t maxKeys = 10000000) {
+        std::printf("%12s %14s %14s %16s %18s %14s\n", "keys", "snapshot ns", "copy ms", "insert ns/op", "snap+insert ns/op", "avl insert ns");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+            PersistentAVLTree<int> persistent;
+            AVLTree<int> avl;
+            double avlInsertNs = measure(n, [&] {
+                for (int key : keys) {
+                    avl.insert(2 * key);
+                }
+            });
+            double insertNs = measure(n, [&] {
+                for (int key : keys) {
+                    persistent.insert(2 * key);
+                }
+            });
+
+            size_t snapshots = 1000;
+            std::vector<PersistentAVLTree<int>> kept;
+            kept.reserve(snapshots);
+            double snapshotNs = measure(snapshots, [&] {
+                for (size_t i = 0; i < snapshots; i++) {
+                    kept.push_back(persistent.snapshot());
+                }
+            });
+            kept.clear();
+
+            AVLTree<int> copy;
+            double copyNs = measure(1, [&] {
+                copy.assignSorted(avl.begin(), avl.end());
+            });
+
+            // Снимок перед каждой записью: каждая вставка копирует путь
+            PersistentAVLTree<int> previous;
+            double snapInsertNs = measure(n, [&] {
+                for (int key : keys) {
+                    previous = persistent.snapshot();
+                    persistent.insert(2 * key + 1);
+                }
+            });
+            std::printf("%12zu %14.2f %14.3f %16.2f %18.2f %14.2f\n", n, snapshotNs, copyNs / 1e6, insertNs, snapInsertNs, avlInsertNs);
+            if (persistent.size() != 2 * n || copy.size() != n || previous.size() != 2 * n - 1) {
+                std::printf("error: wrong sizes\n");
+            }
+        }
+    }
+
+    // Пропускная способность вставки (млн вставок/с) при 1..64 писателях: ShardedAVLTree из 64 шардов
+    // против одного AVLTree под std::mutex. Писатели вставляют свои части перемешанных ключей.
+    static void runShardedInserts(size_t maxKeys = 10000000) {
+        size_t n = std::min<size_t>(maxKeys, 1000000);
+        std::vector<int> keys = shuffledKeys(n, 42);
+        std::printf("%12s %8s %14s %14s\n", "keys", "writers", "sharded Mops", "mutex Mops");
+        for (size_t writers = 1; writers <= 64; writers *= 2) {
+            ShardedAVLTree<int, 64> sharded;
+            double shardedNs = measure(n, [&] {
+                runWriters(writers, n, [&](size_t i) { sharded.insert(keys[i]); });
+            });
+            AVLTree<int> single;
+            std::mutex lock;
+            double mutexNs = measure(n, [&] {
+                runWriters(writers, n, [&](size_t i) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    single.insert(keys[i]);
+                });
+            });
+            std::printf("%12zu %8zu %14.2f %14.2f\n", n, writers, 1e3 / shardedNs, 1e3 / mutexNs);
+            if (sharded.size() != n || single.size() != n) {
+                std::printf("error: sizes %zu and %zu instead of %zu\n", sharded.size(), single.size(), n);
+            }
+        }
+    }
+
+    // Конкурирующие изменения одного дерева при 8, 16 и 64 потоках (25% вставок, 25% удалений, 50% поиска
+    // случайных ключей): плоское комбинирование против AVLTree под std::mutex и под std::shared_mutex
+    // (поиск под разделяемой блокировкой). Пропускная способность в млн операций/с.
+    static void runContendedUpdates(size_t maxKeys = 10000000) {
+        size_t n = std::min<size_t>(maxKeys, 100000);
+        size_t ops = 1000000;
+        std::vector<int> keys = shuffledKeys(2 * n, 42);
+        std::vector<int> initial(n);
+        for (size_t i = 0; i < n; i++) {
+            initial[i] = static_cast<int>(2 * i);
+        }
+        std::printf("%12s %8s %18s %12s %18s\n", "keys", "threads", "flat combining Mops", "mutex Mops", "shared_mutex Mops");
+        for (size_t threads : { 8, 16, 64 }) {
+            FlatCombiningAVLTree<int> combining;
+            for (int key : initial) {
+                combining.insert(key);
+            }
+            double combiningNs = measure(ops, [&] {
+                runWriters(threads, ops, [&](size_t i) {
+                    int key = keys[i % keys.size()];
+                    switch (i % 4) {
+                    case 0: combining.insert(key); break;
+                    case 1: combining.remove(key); break;
+                    default: combining.contains(key); break;
+                    }
+                });
+            });
+
+            AVLTree<int> locked;
+            locked.assignSorted(initial.begin(), initial.end());
+            std::mutex lock;
+            double mutexNs = measure(ops, [&] {
+                runWriters(threads, ops, [&](size_t i) {
+                    int key = keys[i % keys.size()];
+                    std::lock_guard<std::mutex> guard(lock);
+                    switch (i % 4) {
+                    case 0: locked.insert(key); break;
+                    case 1: locked.remove(key); break;
+                    default: locked.findNode(key); break;
+                    }
+                });
+            });
+
+            AVLTree<int> shared;
+            shared.assignSorted(initial.begin(), initial.end());
+            std::shared_mutex sharedLock;
+            double sharedNs = measure(ops, [&] {
+                runWriters(threads, ops, [&](size_t i) {
+                    int key = keys[i % keys.size()];
+                    if (i % 4 >= 2) {
+                        std::shared_lock<std::shared_mutex> guard(sharedLock);
+                        shared.findNode(key);
+                        return;
+                    }
+                    std::unique_lock<std::shared_mutex> guard(sharedLock);
+                    if (i % 4 == 0) {
+                        shared.insert(key);
+                    }
+                    else {
+                        shared.remove(key);
+                    }
+                });
+            });
+            std::printf("%12zu %8zu %18.2f %12.2f %18.2f\n", n, threads, 1e3 / combiningNs, 1e3 / mutexNs, 1e3 / sharedNs);
+        }
+    }
+
+    // Холодный старт: разбор текстового дампа (формат toString) со вставками против загрузки двоичного
+    // файла (построение сбалансированного дерева) и отображения файла в память (без построения).
+    static void runColdStart(size_t maxKeys = 10000000) {
+        std::string path = "avltree_bench.bin";
+        std::printf("%12s %14s %14s %14s %14s %16s\n", "keys", "text parse ms", "save ms", "load ms", "mmap ms", "mapped find ns");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+            AVLTree<int> tree;
+            std::sort(keys.begin(), keys.end());
+            tree.assignSorted(keys.begin(), keys.end());
+
+            std::ostringstream dump;
+            for (int key : tree) {
+                dump << key << ' ';
+            }
+            std::string text = dump.str();
+            AVLTree<int> parsed;
+            double parseNs = measure(1, [&] {
+                std::istringstream in(text);
+                int key;
+                while (in >> key) {
+                    parsed.insert(key);
+                }
+            });
+
+            double saveNs = measure(1, [&] {
+                saveTree(tree, path, TreeLayout::Eytzinger);
+            });
+            AVLTree<int> loaded;
+            double loadNs = measure(1, [&] {
+                loaded = loadTree<int>(path);
+            });
+            size_t found = 0;
+            double mapNs = measure(1, [&] {
+                MappedAVLTree<int> mapped(path);
+                found += mapped.contains(0);
+            });
+
+            MappedAVLTree<int> mapped(path);
+            std::vector<int> queries = shuffledKeys(n, 11);
+            double findNs = measure(queries.size(), [&] {
+                for (int key : queries) {
+                    found += mapped.contains(key);
+                }
+            });
+            std::printf("%12zu %14.3f %14.3f %14.3f %14.3f %16.2f\n", n, parseNs / 1e6, saveNs / 1e6, loadNs / 1e6, mapNs / 1e6, findNs);
+            if (parsed.size() != n || loaded.size() != n || found != n + 1) {
+                std::printf("error: wrong sizes\n");
+            }
+        }
+        std::remove(path.c_str());
+    }
+
+    // Вывод дерева в файл: прежний способ (строка из std::to_string по узлу; печать дерева со сбросом
+    // потока на каждой строке) против write_to/write_tree_to с буфером и to_chars.
+    static void runDump(size_t maxKeys = 10000000) {
+        std::string path = "avltree_dump.txt";
+        std::printf("%12s %16s %16s %16s %16s\n", "keys", "to_string ms", "write_to ms", "endl tree ms", "write_tree ms");
+        for (size_t n = 1000; n <= maxKeys; n *= 10) {
+            std::vector<int> keys = shuffledKeys(n, 42);
+            std::sort(keys.begin(), keys.end());
+            AVLTree<int> tree;
+            tree.assignSorted(keys.begin(), keys.end());
+
+            size_t oldSize = 0;
+            double stringNs = measure(1, [&] {
+                std::string result = "";
+                for (int key : tree) {
+                    result += std::to_string(key) + " ";
+                }
+                std::ofstream out(path);
+                out << result;
+                oldSize = result.size();
+            });
+            double writeNs = measure(1, [&] {
+                std::ofstream out(path);
+                tree.write_to(out);
+            });
+            size_t newSize = static_cast<size_t>(std::ifstream(path, std::ios::ate).tellg());
+
+            double endlNs = measure(1, [&] {
+                std::ofstream out(path);
+                for (auto it = tree.rbegin(); it != tree.rend(); ++it) {
+                    out << "  " << *it << std::endl;
+                }
+            });
+            double layoutNs = measure(1, [&] {
+                std::ofstream out(path);
+                tree.write_tree_to(out);
+            });
+            std::printf("%12zu %16.3f %16.3f %16.3f %16.3f\n", n, stringNs / 1e6, writeNs / 1e6, endlNs / 1e6, layoutNs / 1e6);
+            if (oldSize != newSize) {
+                std::printf("error: dump sizes %zu and %zu differ\n", oldSize, newSize);
+            }
+        }
+        std::remove(path.c_str());
+    }
+
+    // Одна строка сводного набора: контейнер Adapter, ключи вставки inserts, поиска queries, удаления
+    // removals; sorted - те же ключи по возрастанию для пакетного построения. reportPeak - строка
+    // выполняется в своем процессе, и его пиковый RSS относится только к ней.
+    template<typename Adapter>
+    static void runSuiteRow(size_t n, const char* distribution, const std::vector<int>& inserts,
+        const std::vector<int>& queries, const std::vector<int>& removals, const std::vector<int>& sorted, bool reportPeak) {
+        Adapter container;
+        size_t allocations = AllocationCounter::count.load();
+        size_t bytes = AllocationCounter::bytes.load();
+        double insertNs = measure(n, [&] {
+            for (int key : inserts) {
+                container.insert(key);
+            }
+        });
+        double allocationsPerOp = static_cast<double>(AllocationCounter::count.load() - allocations) / static_cast<double>(n);
+        double bytesPerKey = static_cast<double>(AllocationCounter::bytes.load() - bytes) / static_cast<double>(n);
+
+        size_t found = 0;
+        double findNs = measure(queries.size(), [&] {
+            for (int key : queries) {
+                found += container.find(key);
+            }
+        });
+        long long checksum = 0;
+        int last = static_cast<int>(n) - 1;
+        double successorNs = measure(queries.size(), [&] {
+            for (int key : queries) {
+                checksum += container.successor(key == last ? 0 : key);
+            }
+        });
+        double iterateNs = measure(n, [&] {
+            container.iterate([&](int value) { checksum += value; });
+        });
+        double traverseNs = measure(n, [&] {
+            container.traverse([&](int value) { checksum += value; });
+        });
+        double removeNs = measure(removals.size(), [&] {
+            for (int key : removals) {
+                container.remove(key);
+            }
+        });
+
+        Adapter built;
+        double bulkNs = -1;
+        if (built.canBuild()) {
+            bulkNs = measure(n, [&] {
+                built.build(sorted);
+            });
+        }
+
+        std::printf("%10zu %-11s %-5s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f ", n, distribution, Adapter::name(),
+            insertNs, findNs, successorNs, iterateNs, traverseNs, removeNs);
+        if (bulkNs >= 0) {
+            std::printf("%9.1f ", bulkNs);
+        }
+        else {
+            std::printf("%9s ", "-");
+        }
+        if (AllocationCounter::enabled) {
+            std::printf("%10.2f %9.1f ", allocationsPerOp, bytesPerKey);
+        }
+        else {
+            std::printf("%10s %9s ", "-", "-");
+        }
+        if (reportPeak) {
+            std::printf("%9.1f\n", peakRssMb());
+        }
+        else {
+            std::printf("%9s\n", "-");
+        }
+        std::fflush(stdout);
+        if (found != queries.size() || !container.isEmpty() || (bulkNs >= 0 && built.size() != n) || checksum == 0) {
+            std::printf("error: inconsistent results for %s %s\n", distribution, Adapter::name());
+        }
+    }
+
+    // Пиковый объем резидентной памяти процесса, МБ
+    static double peakRssMb() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return 0;
+        }
+        return static_cast<double>(counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0); // Байты
+#else
+        return static_cast<double>(usage.ru_maxrss) / 1024.0; // Килобайты
+#endif
+#endif
+    }
+
+    // Единый интерфейс контейнеров для сводного набора
+    struct SetAdapter {
+        std::set<int> items;
+
+        static const char* name() { return "set"; }
+        void insert(int key) { items.insert(key); }
+        bool find(int key) const { return items.find(key) != items.end(); }
+        int successor(int key) const {
+            auto it = items.upper_bound(key);
+            return it == items.end() ? 0 : *it;
+        }
+        template<typename F>
+        void iterate(F&& func) const {
+            for (int value : items) {
+                func(value);
+            }
+        }
+        template<typename F>
+        void traverse(F&& func) const {
+            std::for_each(items.begin(), items.end(), func);
+        }
+        void remove(int key) { items.erase(key); }
+        bool canBuild() const { return true; }
+        void build(const std::vector<int>& sorted) { items = std::set<int>(sorted.begin(), sorted.end()); }
+        size_t size() const { return items.size(); }
+        bool isEmpty() const { return items.empty(); }
+    };
+
+    struct AVLAdapter {
+        AVLTree<int> items;
+
+        static const char* name() { return "avl"; }
+        void insert(int key) { items.insert(key); }
+        bool find(int key) const { return items.findNode(key) != nullptr; }
+        int successor(int key) const {
+            AVLTreeNode<int>* next = items.ceiling(key + 1);
+            return next == nullptr ? 0 : next->n_data;
+        }
+        template<typename F>
+        void iterate(F&& func) const {
+            for (int value : items) {
+                func(value);
+            }
+        }
+        template<typename F>
+        void traverse(F&& func) const {
+            items.apply([&](const int& value) { func(value); });
+        }
+        void remove(int key) { items.remove(key); }
+        bool canBuild() const { return true; }
+        void build(const std::vector<int>& sorted) { items.assignSorted(sorted.begin(), sorted.end()); }
+        size_t size() const { return items.size(); }
+        bool isEmpty() const { return items.isEmpty(); }
+    };
+
+    struct BSTAdapter {
+        BinarySearchTree<int> items;
+
+        static const char* name() { return "bst"; }
+        void insert(int key) { items.insert(key); }
+        bool find(int key) const { return items.search(key) != nullptr; }
+        int successor(int key) { return items.succesor(key); }
+        template<typename F>
+        void iterate(F&& func) const {
+            for (int value : items) {
+                func(value);
+            }
+        }
+        template<typename F>
+        void traverse(F&& func) {
+            items.apply([&](int& value) { func(value); }, ApplyOrder::Inorder);
+        }
+        void remove(int key) { items.remove(key); }
+        bool canBuild() const { return false; } // Пакетного построения у BinarySearchTree нет
+        void build(const std::vector<int>&) {}
+        size_t size() const { return items.countNodes(); }
+        bool isEmpty() const { return items.isEmpty(); }
+    };
+
+    // Перемешанные ключи 0..n-1
+    static std::vector<int> shuffledKeys(size_t n, unsigned seed) {
+        std::vector<int> keys(n);
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = static_cast<int>(i);
+        }
+        std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+        return keys;
+    }
+
+    // Время выполнения body в наносекундах на одну из ops операций
+    template<typename F>
+    static double measure(size_t ops, F&& body) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto finish = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(finish - start).count() / static_cast<double>(ops);
+    }
+
+    // Выполнение op(i) для i из 0..count-1, разделенных на threads непрерывных частей по потокам
+    template<typename Op>
+    static void runWriters(size_t threads, size_t count, Op&& op) {
+        std::vector<std::thread> list;
+        for (size_t t = 0; t < threads; t++) {
+            list.emplace_back([&, t] {
+                for (size_t i = count * t / threads; i < count * (t + 1) / threads; i++) {
+                    op(i);
+                }
+            });
+        }
+        for (std::thread& thread : list) {
+            thread.join();
+        }
+    }
+
+    // Пропускная способность (млн операций/с) readers потоков, выполняющих read(key) для случайных ключей
+    // 0..2*keys-1 в течение 200 мс, пока отдельный поток вызывает write(нечетный ключ) (в writes - число
+    // его вызовов за секунду).
+    template<typename Read, typename Write>
+    static double throughput(size_t readers, Read&& read, Write&& write, size_t keys, size_t& writes) {
+        std::atomic<bool> done(false);
+        std::atomic<size_t> reads(0);
+        std::atomic<size_t> found(0);
+        std::vector<std::thread> threads;
+        for (size_t r = 0; r < readers; r++) {
+            threads.emplace_back([&, r] {
+                std::mt19937 rng(static_cast<unsigned>(r));
+                size_t count = 0;
+                size_t hits = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    for (int i = 0; i < 64; i++) {
+                        hits += read(static_cast<int>(rng() % (2 * keys)));
+                    }
+                    count += 64;
+                }
+                reads += count;
+                found += hits;
+            });
+        }
+        size_t writeCount = 0;
+        std::thread writer([&] {
+            std::mt19937 rng(99);
+            while (!done.load(std::memory_order_relaxed)) {
+                write(static_cast<int>(rng() % keys) * 2 + 1);
+                writeCount++;
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        done = true;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        writer.join();
+        writes = writeCount * 5;
+        return static_cast<double>(reads.load()) / 0.2 / 1e6;
+    }
+};
@@ -2,9 +2,39 @@
 //
 
 #include <iostream>
+#include <cstring>
+#include <string>
 #include "AVLTreeLegacy.h"
-int main() {
+#include "AVLMap.h"
+#include "AVLTreeBenchmark.h"
+#include "ConcurrentAVLTree.h"
+#include "PersistentAVLTree.h"
+#include "ShardedAVLTree.h"
+#include "FlatCombiningAVLTree.h"
+#include "TreeSerialization.h"
+int main(int argc, char* argv[]) {
+    // Одна строка сводного набора замеров в отдельном процессе (ее запускает runSuite)
+    int rowResult = AVLTreeBenchmark::runSuiteRowCommand(argc, argv);
+    if (rowResult >= 0) {
+        return rowResult;
+    }
+    // Режим замеров: AVLTreeLegacy --bench [максимальное число ключей]
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        size_t maxKeys = argc > 2 ? std::stoull(argv[2]) : 10000000;
+        AVLTreeBenchmark::runAll(maxKeys, argv[0]);
+        return 0;
+    }
+    BinarySearchTree<int>::runTests();
     AVLTree<int>::AVLTreeRunTest();
+    AVLMap<int, int>::runTests();
+    FrozenAVLTree<int>::runTests();
+    FrozenKeyBlocks<int>::runTests();
+    WorkStealingPool::runTests();
+    ConcurrentAVLTree<int>::runTests();
+    PersistentAVLTree<int>::runTests();
+    ShardedAVLTree<int>::runTests();
+    FlatCombiningAVLTree<int>::runTests();
+    MappedAVLTree<int>::runTests();
     AVLTree<int> tree;
 
     tree.insert(5);
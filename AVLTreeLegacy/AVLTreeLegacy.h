@@ -1,11 +1,57 @@
+#pragma once
 
 #include "BinarySearchTree.h"
+#include "FrozenAVLTree.h"
+#include "FrozenKeyBlocks.h"
+#include "WorkStealingPool.h"
 #include <vector>
+#include <algorithm>
+#include <iterator>
+#include <compare>
+#include <tuple>
+#include <memory>
+#include <string>
+#include <span>
+#include <cstdint>
+#include <stdexcept>
+#include <set>
+#include <random>
 //Всатвка O(log2(n))
 // Поиск O(log2(n))
 // Удаление O(log2(n))
 // Повороты O(1)
 // Доступ O(log2(n))
+// Признак прозрачного компаратора (поиск по ключам другого типа без создания временного T)
+template<typename Compare>
+concept TransparentCompare = requires { typename Compare::is_transparent; };
+
+// Компаратор std::less (в том числе прозрачный std::less<>)
+template<typename Compare>
+struct IsStdLess : std::false_type {};
+
+template<typename X>
+struct IsStdLess<std::less<X>> : std::true_type {};
+
+// Трехстороннее сравнение a и b компаратором comp: -1, если a < b, 1, если b < a, иначе 0.
+// Компаратор может предоставить метод three_way(a, b); для std::less используется один вызов
+// operator<=> (для строк это один проход compare вместо двух), в остальных случаях - не больше двух вызовов comp.
+template<typename Compare, typename A, typename B>
+int threeWayCompare(const Compare& comp, const A& a, const B& b) {
+    if constexpr (requires { comp.three_way(a, b); }) {
+        return comp.three_way(a, b);
+    }
+    else if constexpr (IsStdLess<Compare>::value && !std::is_pointer<A>::value && std::three_way_comparable_with<A, B>) {
+        auto order = a <=> b;
+        return order < 0 ? -1 : (order > 0 ? 1 : 0);
+    }
+    else {
+        if (comp(a, b)) {
+            return -1;
+        }
+        return comp(b, a) ? 1 : 0;
+    }
+}
+
 // Класс AVLTreeNode наследуется от TreeNode и имеет дополнительное поле для коэффициента баланса.
 template<typename T>
 class AVLTreeNode : public TreeNode<T> {
@@ -13,27 +59,33 @@ public:
 
 
     // Конструктор по умолчанию.
-    AVLTreeNode() : TreeNode<T>(), balanceFactor(0) {}
+    AVLTreeNode() : TreeNode<T>(), balanceFactor(0), height(1), subtreeSize(1) {}
 
     // Конструктор, принимающий данные.
-    AVLTreeNode(const T& data) : TreeNode<T>(data), balanceFactor(0) {}
+    AVLTreeNode(const T& data) : TreeNode<T>(data), balanceFactor(0), height(1), subtreeSize(1) {}
+
+    // Конструктор, создающий данные на месте из аргументов args.
+    template<typename... Args>
+    AVLTreeNode(std::in_place_t, Args&&... args) : TreeNode<T>(std::in_place, std::forward<Args>(args)...), balanceFactor(0), height(1), subtreeSize(1) {}
 
     // Конструктор, принимающий данные и указатели на предыдущий и следующий узлы.
-    AVLTreeNode(const T& data, TreeNode<T>* getLeft(), TreeNode<T>* getRight()) : TreeNode<T>(data, getLeft(), getRight()), balanceFactor(0) {}
+    AVLTreeNode(const T& data, TreeNode<T>* getLeft(), TreeNode<T>* getRight()) : TreeNode<T>(data, getLeft(), getRight()), balanceFactor(0), height(1), subtreeSize(1) {}
 
     // Деструктор.
     ~AVLTreeNode() {}
 
     // Конструктор копирования.
-    AVLTreeNode(const AVLTreeNode& other) : TreeNode<T>(other), balanceFactor(other.balanceFactor) {}
+    AVLTreeNode(const AVLTreeNode& other) : TreeNode<T>(other), balanceFactor(other.balanceFactor), height(other.height), subtreeSize(other.subtreeSize) {}
 
     // Конструктор перемещения.
-    AVLTreeNode(AVLTreeNode&& other) : TreeNode<T>(std::move(other)), balanceFactor(other.balanceFactor) {}
+    AVLTreeNode(AVLTreeNode&& other) : TreeNode<T>(std::move(other)), balanceFactor(other.balanceFactor), height(other.height), subtreeSize(other.subtreeSize) {}
 
     // Оператор копирования.
     AVLTreeNode& operator=(const AVLTreeNode& other) {
         TreeNode<T>::operator=(other);
         balanceFactor = other.balanceFactor;
+        height = other.height;
+        subtreeSize = other.subtreeSize;
         return *this;
     }
 
@@ -41,9 +93,16 @@ public:
     AVLTreeNode& operator=(AVLTreeNode&& other) {
         TreeNode<T>::operator=(std::move(other));
         balanceFactor = other.balanceFactor;
+        height = other.height;
+        subtreeSize = other.subtreeSize;
         return *this;
     }
 
+    // Преобразовательт указателя на родителя TreeNode в указатель на AVLTreeNode
+    AVLTreeNode<T>* getParent() {
+        return static_cast<AVLTreeNode<T>*>(this->n_parent);
+    }
+
     // Преобразовательт указателя на (на левый) TreeNode в указатель на AVLTreeNode
     AVLTreeNode<T>* getLeft() {
         return static_cast<AVLTreeNode<T>*>(this->n_left);
@@ -67,17 +126,67 @@ public:
     // Коэффициент баланса узла.
     short int balanceFactor;
 
+    // Высота поддерева с корнем в этом узле (лист имеет высоту 1). Хранится в узле,
+    // чтобы балансировка не обходила поддерево заново.
+    int height;
+
+    // Число узлов в поддереве с корнем в этом узле. Нужно для порядковой статистики (select, rank).
+    size_t subtreeSize;
+
 
 };
 
+template<typename K, typename V, typename Compare, typename Alloc>
+class AVLMap;
+
 // Класс AVLTree представляет собой само сбалансированное бинарное дерево поиска.
-template<typename T>
+// Alloc - распределитель памяти для узлов (см. NodeAllocator.h), Compare - порядок элементов
+// (прозрачный компаратор, например std::less<>, разрешает поиск по ключам другого типа).
+template<typename T, typename Alloc = std::allocator<T>, typename Compare = std::less<T>>
 class AVLTree {
 private:
+    template<typename K, typename V, typename C, typename A>
+    friend class AVLMap;
+
+    // Распределитель, перепривязанный к типу узла
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<AVLTreeNode<T>>;
+
     // Указатель на корень дерева.
     AVLTreeNode<T>* root;
 
-    // Функция для обновления коэффициента баланса узла.
+    // Распределитель узлов.
+    NodeAlloc nodeAlloc;
+
+    // Компаратор элементов.
+    Compare comp;
+
+#ifdef AVLTREE_STATS
+    // Счетчики операций (см. TreeStats.h). Изменяются и константными методами поиска.
+    mutable TreeCounters counters;
+#endif
+
+    // Трехстороннее сравнение: <0, 0, >0. Одно сравнение на узел при спуске; сравнения считает
+    // вызывающая операция и прибавляет к счетчикам один раз за операцию.
+    template<typename A, typename B>
+    int compareKeys(const A& a, const B& b) const {
+        return threeWayCompare(comp, a, b);
+    }
+
+    // Создание узла распределителем дерева из args. Log2N | Log2N | 1
+    template<typename... Args>
+    AVLTreeNode<T>* newNode(Args&&... args) {
+        AVLTreeNode<T>* node = allocateNode(nodeAlloc, std::forward<Args>(args)...);
+        AVLTREE_STAT(counters.countAllocations(1));
+        return node;
+    }
+
+    // Уничтожение узла, созданного newNode. 1 | 1 | 1
+    void deleteNode(AVLTreeNode<T>* node) {
+        freeNode(nodeAlloc, node);
+        AVLTREE_STAT(counters.countFrees(1));
+    }
+
+    // Функция для обновления высоты, коэффициента баланса и размера поддерева узла по его детям. O(1)
     void updateBalanceFactor(AVLTreeNode<T>* node) {
         if (node == nullptr) {
             return;
@@ -86,22 +195,38 @@ private:
         int leftHeight = getHeight(node->getLeft());
         int rightHeight = getHeight(node->getRight());
         node->balanceFactor = leftHeight - rightHeight;
+        node->height = 1 + std::max(leftHeight, rightHeight);
+        node->subtreeSize = 1 + getSize(node->getLeft()) + getSize(node->getRight());
+    }
+
+    // Функция для получения числа узлов поддерева (хранится в узле). O(1)
+    static size_t getSize(const AVLTreeNode<T>* node) {
+        if (node == nullptr) {
+            return 0;
+        }
+
+        return node->subtreeSize;
     }
 
-    // Функция для получения высоты узла.
-    int getHeight(AVLTreeNode<T>* node) {
+    // Функция для получения высоты узла (хранится в узле). O(1)
+    int getHeight(const AVLTreeNode<T>* node) const {
         if (node == nullptr) {
             return 0;
         }
 
-        return 1 + std::max(getHeight(node->getLeft()), getHeight(node->getRight()));
+        return node->height;
     }
 
-    // Функция для правого поворота.
+    // Функция для правого поворота. Родитель node должен сам перевесить ссылку на возвращаемый узел.
     AVLTreeNode<T>* rotateRight(AVLTreeNode<T>* node) {
         AVLTreeNode<T>* temp = node->getLeft();
         node->n_left = temp->getRight();
+        if (node->n_left != nullptr) {
+            node->n_left->n_parent = node;
+        }
         temp->n_right = node;
+        temp->n_parent = node->n_parent;
+        node->n_parent = temp;
 
         updateBalanceFactor(node);
         updateBalanceFactor(temp);
@@ -109,11 +234,16 @@ private:
         return temp;
     }
 
-    // Функция для левого поворота.
+    // Функция для левого поворота. Родитель node должен сам перевесить ссылку на возвращаемый узел.
     AVLTreeNode<T>* rotateLeft(AVLTreeNode<T>* node) {
         AVLTreeNode<T>* temp = node->getRight();
         node->n_right = temp->getLeft();
+        if (node->n_right != nullptr) {
+            node->n_right->n_parent = node;
+        }
         temp->n_left = node;
+        temp->n_parent = node->n_parent;
+        node->n_parent = temp;
 
         updateBalanceFactor(node);
         updateBalanceFactor(temp);
@@ -121,6 +251,23 @@ private:
         return temp;
     }
 
+    // Функция для уничтожения поддерева.
+    void clearNode(AVLTreeNode<T>* node) {
+        AVLTREE_STAT(counters.countFrees(getSize(node)));
+        clearNodeWith(node, nodeAlloc);
+    }
+
+    // Уничтожение поддерева, узлы которого выделены распределителем alloc (например, другого дерева).
+    static void clearNodeWith(AVLTreeNode<T>* node, NodeAlloc& alloc) {
+        if (node == nullptr) {
+            return;
+        }
+
+        clearNodeWith(node->getLeft(), alloc);
+        clearNodeWith(node->getRight(), alloc);
+        freeNode(alloc, node);
+    }
+
     // Функция для балансировки дерева.
     AVLTreeNode<T>* balanceTree(AVLTreeNode<T>* node) {
         if (node == nullptr) {
@@ -133,143 +280,1221 @@ private:
             if (getHeight(node->getLeft()->getLeft()) >= getHeight(node->getLeft()->getRight())) {
                 //Одинарный правый поворот
                 node = rotateRight(node);
+                AVLTREE_STAT(counters.countRotation(false));
             }
             else {
                 //Большой правый поворот
                 node->n_left = rotateLeft(node->getLeft());
                 node = rotateRight(node);
+                AVLTREE_STAT(counters.countRotation(true));
+            }
+        }
+        else if (node->balanceFactor < -1) {
+            if (getHeight(node->getRight()->getRight()) >= getHeight(node->getRight()->getLeft())) {
+                //Одинарный левый поворот
+                node = rotateLeft(node);
+                AVLTREE_STAT(counters.countRotation(false));
+            }
+            else {
+                //Большой левый поворот
+                node->n_right = rotateRight(node->getRight());
+                node = rotateLeft(node);
+                AVLTREE_STAT(counters.countRotation(true));
+            }
+        }
+
+        return node;
+    }
+
+    // Число различных значений отсортированного по неубыванию диапазона [first, last). N | N | 1
+    template<typename It>
+    size_t countDistinct(It first, It last) const {
+        size_t count = 0;
+        for (It it = first; it != last; ) {
+            It current = it;
+            ++it;
+            while (it != last && !comp(*current, *it)) {
+                ++it;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    // Построение идеально сбалансированного поддерева из count различных значений, читаемых из
+    // отсортированного диапазона [it, last) по порядку. Повторы подряд пропускаются. N | N | N
+    template<typename It>
+    AVLTreeNode<T>* buildSorted(It& it, const It& last, size_t count) {
+        if (count == 0) {
+            return nullptr;
+        }
+
+        size_t leftCount = (count - 1) / 2;
+        AVLTreeNode<T>* left = buildSorted(it, last, leftCount);
+        AVLTreeNode<T>* node;
+        try {
+            node = newNode(*it);
+        }
+        catch (...) {
+            clearNode(left);
+            throw;
+        }
+        ++it;
+        while (it != last && !comp(node->n_data, *it)) {
+            ++it; // Повтор предыдущего значения
+        }
+        try {
+            node->n_right = buildSorted(it, last, count - 1 - leftCount);
+        }
+        catch (...) {
+            clearNode(left);
+            deleteNode(node);
+            throw;
+        }
+        node->n_left = left;
+        if (left != nullptr) {
+            left->n_parent = node;
+        }
+        if (node->n_right != nullptr) {
+            node->n_right->n_parent = node;
+        }
+        updateBalanceFactor(node);
+        return node;
+    }
+
+    // Спуск к месту ключа key с записью пути в path. Возвращает узел с таким ключом или nullptr;
+    // в order остается результат последнего сравнения (с какой стороны подвешивать новый узел). Log2N | Log2N | 1
+    template<typename Key>
+    AVLTreeNode<T>* descend(const Key& key, AVLTreeNode<T>** path, int& depth, int& order) const {
+        depth = 0;
+        order = 0;
+        AVLTreeNode<T>* current = root;
+        while (current != nullptr) {
+            path[depth++] = current;
+            order = compareKeys(key, current->n_data);
+            if (order < 0) {
+                current = current->getLeft();
+            }
+            else if (order > 0) {
+                current = current->getRight();
+            }
+            else {
+                AVLTREE_STAT(counters.recordSearch(depth));
+                return current;
+            }
+        }
+        AVLTREE_STAT(counters.recordSearch(depth));
+        return nullptr;
+    }
+
+    // Подвешивание нового узла node под path[depth - 1] со стороны order и балансировка. Log2N | Log2N | 1
+    void attachNode(AVLTreeNode<T>** path, int depth, int order, AVLTreeNode<T>* node) {
+        if (depth == 0) {
+            root = node;
+            return;
+        }
+        AVLTreeNode<T>* parent = path[depth - 1];
+        if (order < 0) {
+            parent->n_left = node;
+        }
+        else {
+            parent->n_right = node;
+        }
+        node->n_parent = parent;
+        // Размеры меняются у всех предков, а высоты - только до первого неизменившегося поддерева
+        for (int i = 0; i < depth; i++) {
+            path[i]->subtreeSize++;
+        }
+        retrace(path, depth);
+    }
+
+    // Вставка элемента с ключом key, если его еще нет: элемент создается на месте из args только после
+    // того, как спуск не нашел ключ. Возвращает узел с ключом и признак вставки. Log2N | Log2N | 1
+    template<typename Key, typename... Args>
+    std::pair<AVLTreeNode<T>*, bool> insertUnique(const Key& key, Args&&... args) {
+        AVLTreeNode<T>* path[MAX_HEIGHT];
+        int depth;
+        int order;
+        AVLTreeNode<T>* found = descend(key, path, depth, order);
+        if (found != nullptr) {
+            return std::make_pair(found, false); // Такой элемент уже есть
+        }
+
+        AVLTreeNode<T>* node = newNode(std::in_place, std::forward<Args>(args)...);
+        attachNode(path, depth, order, node);
+        return std::make_pair(node, true);
+    }
+
+    // Удаление элемента с ключом key. Возвращает true, если элемент был. Log2N | Log2N | 1
+    template<typename Key>
+    bool removeKey(const Key& key) {
+        AVLTreeNode<T>* path[MAX_HEIGHT];
+        int depth;
+        int order;
+        AVLTreeNode<T>* node = descend(key, path, depth, order);
+        if (node == nullptr) {
+            return false; // Элемент не найден
+        }
+        unlinkNode(path, depth - 1, node);
+        return true;
+    }
+
+    // Удаление узла node; path[0..depth) - его предки от корня. Log2N | Log2N | 1
+    void unlinkNode(AVLTreeNode<T>** path, int depth, AVLTreeNode<T>* node) {
+        AVLTreeNode<T>* parent = depth > 0 ? path[depth - 1] : nullptr;
+        if (node->getLeft() == nullptr || node->getRight() == nullptr) {
+            AVLTreeNode<T>* child = node->getLeft() != nullptr ? node->getLeft() : node->getRight();
+            replaceChild(parent, node, child);
+        }
+        else {
+            // Преемник - самый левый узел правого поддерева; он занимает место удаляемого узла
+            int nodeIndex = depth;
+            path[depth++] = node;
+            AVLTreeNode<T>* successor = node->getRight();
+            while (successor->getLeft() != nullptr) {
+                path[depth++] = successor;
+                successor = successor->getLeft();
+            }
+
+            AVLTreeNode<T>* successorParent = path[depth - 1];
+            if (successorParent == node) {
+                node->n_right = successor->n_right;
+            }
+            else {
+                successorParent->n_left = successor->n_right;
+                if (successor->n_right != nullptr) {
+                    successor->n_right->n_parent = successorParent;
+                }
+            }
+            successor->n_left = node->n_left;
+            successor->n_right = node->n_right;
+            successor->n_left->n_parent = successor;
+            if (successor->n_right != nullptr) {
+                successor->n_right->n_parent = successor;
+            }
+            successor->height = node->height;
+            successor->balanceFactor = node->balanceFactor;
+            successor->subtreeSize = node->subtreeSize;
+            replaceChild(parent, node, successor);
+            path[nodeIndex] = successor;
+        }
+        deleteNode(node);
+        for (int i = 0; i < depth; i++) {
+            path[i]->subtreeSize--;
+        }
+        retrace(path, depth);
+    }
+
+    // Узлы дерева в порядке возрастания. N | N | N
+    std::vector<AVLTreeNode<T>*> collectNodes(size_t reserve) const {
+        std::vector<AVLTreeNode<T>*> nodes;
+        nodes.reserve(reserve);
+        for (TreeNode<T>* node = root == nullptr ? nullptr : leftmostNode<T>(root); node != nullptr; node = inorderNext<T>(node)) {
+            nodes.push_back(static_cast<AVLTreeNode<T>*>(node));
+        }
+        return nodes;
+    }
+
+    // Сбалансированное дерево из count упорядоченных узлов nodes без выделения памяти: узлы только
+    // перевязываются, их адреса и значения не меняются. N | N | Log2N
+    AVLTreeNode<T>* linkSorted(AVLTreeNode<T>** nodes, size_t count, AVLTreeNode<T>* parent) {
+        if (count == 0) {
+            return nullptr;
+        }
+        size_t leftCount = (count - 1) / 2;
+        AVLTreeNode<T>* node = nodes[leftCount];
+        node->n_parent = parent;
+        node->n_left = linkSorted(nodes, leftCount, node);
+        node->n_right = linkSorted(nodes + leftCount + 1, count - 1 - leftCount, node);
+        updateBalanceFactor(node);
+        return node;
+    }
+
+    // Слияние с перестройкой (N + M, но проход по всем узлам дерева) выгоднее split/join, когда пакет
+    // не меньше дерева; при меньших пакетах по замерам (runSortedBatch) быстрее split/join.
+    bool preferRebuild(size_t batch) const {
+        return batch >= size();
+    }
+
+    // Узел с ключом key или nullptr. Log2N | Log2N | 1
+    template<typename Key>
+    AVLTreeNode<T>* findNodeKey(const Key& key) const {
+        AVLTreeNode<T>* current = root;
+        AVLTREE_STAT(uint64_t length = 0);
+        while (current != nullptr) {
+            AVLTREE_STAT(length++);
+            int order = compareKeys(key, current->n_data);
+            if (order < 0) {
+                current = current->getLeft();
+            }
+            else if (order > 0) {
+                current = current->getRight();
+            }
+            else {
+                AVLTREE_STAT(counters.recordSearch(length));
+                return current; // Найдено
+            }
+        }
+        AVLTREE_STAT(counters.recordSearch(length));
+        return nullptr; // Не найдено
+    }
+
+    // Число элементов, меньших key. Log2N | Log2N | 1
+    template<typename Key>
+    size_t rankKey(const Key& key) const {
+        size_t result = 0;
+        AVLTreeNode<T>* current = root;
+        AVLTREE_STAT(uint64_t compared = 0);
+        while (current != nullptr) {
+            AVLTREE_STAT(compared++);
+            int order = compareKeys(key, current->n_data);
+            if (order < 0) {
+                current = current->getLeft();
+            }
+            else if (order > 0) {
+                result += getSize(current->getLeft()) + 1;
+                current = current->getRight();
+            }
+            else {
+                result += getSize(current->getLeft());
+                break;
+            }
+        }
+        AVLTREE_STAT(counters.countComparisons(compared));
+        return result;
+    }
+
+    // Первый узел, не меньший key (upper == false) или больший key (upper == true), или nullptr. Log2N | Log2N | 1
+    template<typename Key>
+    AVLTreeNode<T>* boundNode(const Key& key, bool upper) const {
+        AVLTreeNode<T>* result = nullptr;
+        AVLTreeNode<T>* current = root;
+        AVLTREE_STAT(uint64_t length = 0);
+        while (current != nullptr) {
+            AVLTREE_STAT(length++);
+            if (upper ? comp(key, current->n_data) : !comp(current->n_data, key)) {
+                result = current;
+                current = current->getLeft();
+            }
+            else {
+                current = current->getRight();
+            }
+        }
+        AVLTREE_STAT(counters.recordSearch(length));
+        return result;
+    }
+
+    // Последний узел, не больший key, или nullptr. Log2N | Log2N | 1
+    template<typename Key>
+    AVLTreeNode<T>* floorNode(const Key& key) const {
+        AVLTreeNode<T>* result = nullptr;
+        AVLTreeNode<T>* current = root;
+        while (current != nullptr) {
+            if (comp(key, current->n_data)) {
+                current = current->getLeft();
+            }
+            else {
+                result = current;
+                current = current->getRight();
+            }
+        }
+        return result;
+    }
+
+    // Сколько поисков пакета идут одновременно: пока ждем узел одного ключа, спускаемся по остальным
+    static constexpr size_t BATCH_WIDTH = 16;
+
+    // Поиск группы из count <= BATCH_WIDTH ключей вперемешку: за один проход каждый незавершенный поиск
+    // спускается на уровень и заранее подгружает следующий узел. Log2N | Log2N | 1 на ключ
+    void findBatchGroup(const T* keys, AVLTreeNode<T>** out, size_t count) const {
+        AVLTreeNode<T>* cursor[BATCH_WIDTH];
+        size_t active[BATCH_WIDTH];
+        size_t activeCount = root == nullptr ? 0 : count;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = nullptr;
+            cursor[i] = root;
+            active[i] = i;
+        }
+        AVLTREE_STAT(uint64_t compared = 0);
+        while (activeCount > 0) {
+            AVLTREE_STAT(compared += activeCount);
+            size_t stillActive = 0;
+            for (size_t j = 0; j < activeCount; j++) {
+                size_t i = active[j];
+                int order = compareKeys(keys[i], cursor[i]->n_data);
+                if (order == 0) {
+                    out[i] = cursor[i];
+                    continue;
+                }
+                AVLTreeNode<T>* child = order < 0 ? cursor[i]->getLeft() : cursor[i]->getRight();
+                if (child != nullptr) {
+                    prefetchRead(child);
+                    cursor[i] = child;
+                    active[stillActive++] = i;
+                }
+            }
+            activeCount = stillActive;
+        }
+        AVLTREE_STAT(counters.countComparisons(compared));
+    }
+
+    // Максимальная высота AVL-дерева: h <= 1.44 * log2(n + 2), для 64-битного числа узлов это меньше 96.
+    // Путь от корня до листа всегда помещается в массив такого размера на стеке.
+    static const int MAX_HEIGHT = 96;
+
+    // Заменяет ребенка oldChild узла parent на newChild (если parent пуст, меняется корень).
+    void replaceChild(AVLTreeNode<T>* parent, AVLTreeNode<T>* oldChild, AVLTreeNode<T>* newChild) {
+        if (parent == nullptr) {
+            root = newChild;
+        }
+        else if (parent->n_left == oldChild) {
+            parent->n_left = newChild;
+        }
+        else {
+            parent->n_right = newChild;
+        }
+        if (newChild != nullptr) {
+            newChild->n_parent = parent;
+        }
+    }
+
+    // Узел node с детьми left и right (родитель не задается). O(1)
+    AVLTreeNode<T>* linkNode(AVLTreeNode<T>* node, AVLTreeNode<T>* left, AVLTreeNode<T>* right) {
+        node->n_left = left;
+        node->n_right = right;
+        if (left != nullptr) {
+            left->n_parent = node;
+        }
+        if (right != nullptr) {
+            right->n_parent = node;
+        }
+        updateBalanceFactor(node);
+        return node;
+    }
+
+    // Спуск по правому краю left до поддерева высоты не больше h(right) + 1, подвешивание там
+    // middle с right и балансировка на обратном пути. Нужно h(left) > h(right) + 1.
+    AVLTreeNode<T>* joinRight(AVLTreeNode<T>* left, AVLTreeNode<T>* middle, AVLTreeNode<T>* right) {
+        AVLTreeNode<T>* inner = left->getRight();
+        AVLTreeNode<T>* joined = getHeight(inner) <= getHeight(right) + 1
+            ? linkNode(middle, inner, right)
+            : joinRight(inner, middle, right);
+        left->n_right = joined;
+        joined->n_parent = left;
+        return balanceTree(left);
+    }
+
+    // Зеркально joinRight: нужно h(right) > h(left) + 1.
+    AVLTreeNode<T>* joinLeft(AVLTreeNode<T>* left, AVLTreeNode<T>* middle, AVLTreeNode<T>* right) {
+        AVLTreeNode<T>* inner = right->getLeft();
+        AVLTreeNode<T>* joined = getHeight(inner) <= getHeight(left) + 1
+            ? linkNode(middle, left, inner)
+            : joinLeft(left, middle, inner);
+        right->n_left = joined;
+        joined->n_parent = right;
+        return balanceTree(right);
+    }
+
+    // Соединение (join): все элементы left меньше middle, все элементы right больше. Узел middle
+    // перевязывается, повороты идут только вдоль одного края. |h(left) - h(right)| + 1 | Log2N | Log2N
+    AVLTreeNode<T>* joinNodes(AVLTreeNode<T>* left, AVLTreeNode<T>* middle, AVLTreeNode<T>* right) {
+        AVLTreeNode<T>* joined;
+        if (getHeight(left) > getHeight(right) + 1) {
+            joined = joinRight(left, middle, right);
+        }
+        else if (getHeight(right) > getHeight(left) + 1) {
+            joined = joinLeft(left, middle, right);
+        }
+        else {
+            joined = linkNode(middle, left, right);
+        }
+        joined->n_parent = nullptr;
+        return joined;
+    }
+
+    // Отделение самого правого узла: в last - этот узел, возвращается остальное дерево. Log2N | Log2N | Log2N
+    AVLTreeNode<T>* splitLast(AVLTreeNode<T>* node, AVLTreeNode<T>*& last) {
+        if (node->getRight() == nullptr) {
+            last = node;
+            AVLTreeNode<T>* rest = node->getLeft();
+            if (rest != nullptr) {
+                rest->n_parent = nullptr;
+            }
+            return rest;
+        }
+        AVLTreeNode<T>* rest = splitLast(node->getRight(), last);
+        return joinNodes(node->getLeft(), node, rest);
+    }
+
+    // Соединение без среднего элемента: все элементы left меньше всех элементов right. Log2N | Log2N | Log2N
+    AVLTreeNode<T>* joinNodes(AVLTreeNode<T>* left, AVLTreeNode<T>* right) {
+        if (left == nullptr) {
+            return right;
+        }
+        if (right == nullptr) {
+            return left;
+        }
+        AVLTreeNode<T>* last;
+        AVLTreeNode<T>* rest = splitLast(left, last);
+        return joinNodes(rest, last, right);
+    }
+
+    // Разрезание (split) поддерева node по key: less - элементы меньше key, equal - узел с key или nullptr,
+    // greater - элементы больше key. Узлы только перевязываются. Log2N | Log2N | Log2N
+    template<typename Key>
+    void splitNodes(AVLTreeNode<T>* node, const Key& key, AVLTreeNode<T>*& less, AVLTreeNode<T>*& equal, AVLTreeNode<T>*& greater) {
+        uint64_t compared = 0;
+        splitPath(node, key, less, equal, greater, compared);
+        AVLTREE_STAT(counters.countComparisons(compared));
+    }
+
+    // Рекурсия splitNodes; compared - число сравнений на пути разреза. Log2N | Log2N | Log2N
+    template<typename Key>
+    void splitPath(AVLTreeNode<T>* node, const Key& key, AVLTreeNode<T>*& less, AVLTreeNode<T>*& equal, AVLTreeNode<T>*& greater,
+        uint64_t& compared) {
+        if (node == nullptr) {
+            less = equal = greater = nullptr;
+            return;
+        }
+        AVLTreeNode<T>* left = node->getLeft();
+        AVLTreeNode<T>* right = node->getRight();
+        compared++;
+        int order = compareKeys(key, node->n_data);
+        if (order == 0) {
+            less = left;
+            equal = node;
+            greater = right;
+            if (less != nullptr) {
+                less->n_parent = nullptr;
+            }
+            if (greater != nullptr) {
+                greater->n_parent = nullptr;
+            }
+        }
+        else if (order < 0) {
+            AVLTreeNode<T>* middle;
+            splitPath(left, key, less, equal, middle, compared);
+            greater = joinNodes(middle, node, right);
+        }
+        else {
+            AVLTreeNode<T>* middle;
+            splitPath(right, key, middle, equal, greater, compared);
+            less = joinNodes(left, node, middle);
+        }
+    }
+
+    // Объединение поддеревьев a (узлы этого дерева) и b (узлы с распределителем otherAlloc, равным nodeAlloc):
+    // b режется по корню a, половины объединяются рекурсивно. Повторы из b освобождаются. M*Log2(N/M + 1)
+    AVLTreeNode<T>* unionNodes(AVLTreeNode<T>* a, AVLTreeNode<T>* b, NodeAlloc& otherAlloc) {
+        if (a == nullptr) {
+            return b;
+        }
+        if (b == nullptr) {
+            return a;
+        }
+        AVLTreeNode<T>* aLeft = a->getLeft();
+        AVLTreeNode<T>* aRight = a->getRight();
+        AVLTreeNode<T>* less;
+        AVLTreeNode<T>* equal;
+        AVLTreeNode<T>* greater;
+        splitNodes(b, a->n_data, less, equal, greater);
+        if (equal != nullptr) {
+            freeNode(otherAlloc, equal);
+        }
+        AVLTreeNode<T>* left = unionNodes(aLeft, less, otherAlloc);
+        AVLTreeNode<T>* right = unionNodes(aRight, greater, otherAlloc);
+        return joinNodes(left, a, right);
+    }
+
+    // Пересечение: остаются только узлы a, чьи значения есть в b; все узлы b освобождаются. M*Log2(N/M + 1)
+    AVLTreeNode<T>* intersectNodes(AVLTreeNode<T>* a, AVLTreeNode<T>* b, NodeAlloc& otherAlloc) {
+        if (a == nullptr || b == nullptr) {
+            clearNode(a);
+            clearNodeWith(b, otherAlloc);
+            return nullptr;
+        }
+        AVLTreeNode<T>* aLeft = a->getLeft();
+        AVLTreeNode<T>* aRight = a->getRight();
+        AVLTreeNode<T>* less;
+        AVLTreeNode<T>* equal;
+        AVLTreeNode<T>* greater;
+        splitNodes(b, a->n_data, less, equal, greater);
+        AVLTreeNode<T>* left = intersectNodes(aLeft, less, otherAlloc);
+        AVLTreeNode<T>* right = intersectNodes(aRight, greater, otherAlloc);
+        if (equal != nullptr) {
+            freeNode(otherAlloc, equal);
+            return joinNodes(left, a, right);
+        }
+        deleteNode(a);
+        return joinNodes(left, right);
+    }
+
+    // Разность: остаются узлы a, чьих значений нет в b; все узлы b освобождаются. M*Log2(N/M + 1)
+    AVLTreeNode<T>* differenceNodes(AVLTreeNode<T>* a, AVLTreeNode<T>* b, NodeAlloc& otherAlloc) {
+        if (a == nullptr || b == nullptr) {
+            clearNodeWith(b, otherAlloc);
+            return a;
+        }
+        AVLTreeNode<T>* aLeft = a->getLeft();
+        AVLTreeNode<T>* aRight = a->getRight();
+        AVLTreeNode<T>* less;
+        AVLTreeNode<T>* equal;
+        AVLTreeNode<T>* greater;
+        splitNodes(b, a->n_data, less, equal, greater);
+        AVLTreeNode<T>* left = differenceNodes(aLeft, less, otherAlloc);
+        AVLTreeNode<T>* right = differenceNodes(aRight, greater, otherAlloc);
+        if (equal != nullptr) {
+            freeNode(otherAlloc, equal);
+            deleteNode(a);
+            return joinNodes(left, right);
+        }
+        return joinNodes(left, a, right);
+    }
+
+    // Поддеревья меньше этого размера обрабатываются последовательно: дробить их дороже, чем выполнить
+    static constexpr size_t PARALLEL_CUTOFF = 8192;
+
+    // Параллельные операции включаются, только если распределитель узлов потокобезопасен
+    static constexpr bool PARALLEL_SAFE = IsThreadSafeAllocator<NodeAlloc>::value;
+
+    // Параллельный buildSorted по count строго возрастающим значениям, начиная с first (итератор
+    // произвольного доступа): половины строятся разными потоками пула. N | N | Log2N
+    template<typename It>
+    AVLTreeNode<T>* buildSortedParallel(It first, size_t count, WorkStealingPool& pool) {
+        if (count <= PARALLEL_CUTOFF) {
+            It it = first;
+            return buildSorted(it, first + count, count);
+        }
+        size_t leftCount = (count - 1) / 2;
+        AVLTreeNode<T>* node = newNode(*(first + leftCount));
+        AVLTreeNode<T>* left = nullptr;
+        AVLTreeNode<T>* right = nullptr;
+        try {
+            pool.invoke([&] { left = buildSortedParallel(first, leftCount, pool); },
+                [&] { right = buildSortedParallel(first + (leftCount + 1), count - 1 - leftCount, pool); });
+        }
+        catch (...) {
+            clearNode(left);
+            clearNode(right);
+            deleteNode(node);
+            throw;
+        }
+        return linkNode(node, left, right);
+    }
+
+    // Параллельные unionNodes/intersectNodes/differenceNodes: после разрезания b по корню a обе половины
+    // обрабатываются разными потоками пула. Поддеревья не пересекаются, поэтому синхронизация не нужна.
+    // M*Log2(N/M + 1) | M*Log2(N/M + 1) | Log2N
+    enum class SetOperation { Union, Intersection, Difference };
+
+    AVLTreeNode<T>* setNodesParallel(SetOperation operation, AVLTreeNode<T>* a, AVLTreeNode<T>* b, NodeAlloc& otherAlloc, WorkStealingPool& pool) {
+        if (getSize(a) + getSize(b) <= PARALLEL_CUTOFF || a == nullptr || b == nullptr) {
+            switch (operation) {
+            case SetOperation::Union:
+                return unionNodes(a, b, otherAlloc);
+            case SetOperation::Intersection:
+                return intersectNodes(a, b, otherAlloc);
+            default:
+                return differenceNodes(a, b, otherAlloc);
+            }
+        }
+        AVLTreeNode<T>* aLeft = a->getLeft();
+        AVLTreeNode<T>* aRight = a->getRight();
+        AVLTreeNode<T>* less;
+        AVLTreeNode<T>* equal;
+        AVLTreeNode<T>* greater;
+        splitNodes(b, a->n_data, less, equal, greater);
+        AVLTreeNode<T>* left = nullptr;
+        AVLTreeNode<T>* right = nullptr;
+        pool.invoke([&] { left = setNodesParallel(operation, aLeft, less, otherAlloc, pool); },
+            [&] { right = setNodesParallel(operation, aRight, greater, otherAlloc, pool); });
+        bool keep = operation == SetOperation::Union || (operation == SetOperation::Intersection) == (equal != nullptr);
+        if (equal != nullptr) {
+            freeNode(otherAlloc, equal);
+        }
+        if (keep) {
+            return joinNodes(left, a, right);
+        }
+        deleteNode(a);
+        return joinNodes(left, right);
+    }
+
+    // Параллельная операция над множествами с деревом other (его узлы расходуются)
+    void applySetParallel(SetOperation operation, AVLTree&& other, WorkStealingPool& pool) {
+        AVLTreeNode<T>* b = other.root;
+        other.root = nullptr;
+        if constexpr (!PARALLEL_SAFE) {
+            switch (operation) {
+            case SetOperation::Union:
+                setRoot(unionNodes(root, b, other.nodeAlloc));
+                break;
+            case SetOperation::Intersection:
+                setRoot(intersectNodes(root, b, other.nodeAlloc));
+                break;
+            default:
+                setRoot(differenceNodes(root, b, other.nodeAlloc));
+                break;
+            }
+        }
+        else {
+            AVLTreeNode<T>* result = nullptr;
+            pool.run([&] { result = setNodesParallel(operation, root, b, other.nodeAlloc, pool); });
+            setRoot(result);
+        }
+    }
+
+    // Корень из результата операции над поддеревьями: он может быть пустым, а непустой может оставаться
+    // ребенком бывшего родителя (joinNodes(left, nullptr) возвращает left как есть). 1 | 1 | 1
+    void setRoot(AVLTreeNode<T>* node) {
+        root = node;
+        if (root != nullptr) {
+            root->n_parent = nullptr;
+        }
+    }
+
+    // Разбиение поддерева node на независимые поддеревья не больше chunkSize узлов (chunks) и узлы над
+    // ними в прямом порядке (tops). P | P | Log2N
+    static void splitForParallel(AVLTreeNode<T>* node, size_t chunkSize, vector<TreeNode<T>*>& tops, vector<TreeNode<T>*>& chunks) {
+        if (node == nullptr) {
+            return;
+        }
+        if (getSize(node) <= chunkSize) {
+            chunks.push_back(node);
+            return;
+        }
+        tops.push_back(node);
+        splitForParallel(node->getLeft(), chunkSize, tops, chunks);
+        splitForParallel(node->getRight(), chunkSize, tops, chunks);
+    }
+
+    // Копия other с распределителем этого дерева. N | N | N
+    AVLTree copyOf(const AVLTree& other) const {
+        AVLTree copy(comp, nodeAlloc);
+        copy.assignSorted(other.begin(), other.end());
+        return copy;
+    }
+
+    // Дерево other с узлами, которые можно перевесить в это дерево: при равных распределителях - само other,
+    // иначе его элементы перемещаются в новые узлы нашего распределителя. N | N | N
+    AVLTree adoptable(AVLTree&& other) {
+        if (nodeAlloc == other.nodeAlloc) {
+            return std::move(other);
+        }
+        AVLTree adopted(comp, nodeAlloc);
+        adopted.assignSorted(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+        other.clear();
+        return adopted;
+    }
+
+    // Подъем по пути path[0..depth-1] снизу вверх с балансировкой. Останавливается, как только
+    // высота очередного поддерева не изменилась: выше коэффициенты баланса уже верны. Log2N | Log2N | 1
+    void retrace(AVLTreeNode<T>** path, int depth) {
+        for (int i = depth - 1; i >= 0; i--) {
+            AVLTreeNode<T>* node = path[i];
+            int oldHeight = node->height;
+            AVLTreeNode<T>* balanced = balanceTree(node);
+            if (balanced != node) {
+                replaceChild(i > 0 ? path[i - 1] : nullptr, node, balanced);
+            }
+            if (balanced->height == oldHeight) {
+                break;
+            }
+        }
+    }
+
+public:
+    // Конструктор по умолчанию.
+    AVLTree(const Alloc& alloc = Alloc()) : root(nullptr), nodeAlloc(alloc), comp() {}
+
+    // Конструктор с компаратором.
+    explicit AVLTree(const Compare& compare, const Alloc& alloc = Alloc()) : root(nullptr), nodeAlloc(alloc), comp(compare) {}
+
+    // Конструктор из диапазона значений (см. assign). N | NLog2N | N
+    template<typename It> requires std::input_iterator<It>
+    AVLTree(It first, It last, const Alloc& alloc = Alloc()) : root(nullptr), nodeAlloc(alloc), comp() {
+        assign(first, last);
+    }
+
+    // Перемещение: узлы и распределитель переходят к новому дереву, other остается пустым. O(1)
+    AVLTree(AVLTree&& other) noexcept : root(other.root), nodeAlloc(std::move(other.nodeAlloc)), comp(other.comp) {
+        other.root = nullptr;
+    }
+
+    // Перемещающее присваивание: узлы other перевешиваются, если распределитель переходит вместе с ними
+    // (propagate_on_container_move_assignment) или распределители равны; иначе (например, pmr с разными
+    // ресурсами) элементы перемещаются в новые узлы нашего распределителя. other остается пустым. 1 | N | 1
+    AVLTree& operator=(AVLTree&& other) {
+        if (this == &other) {
+            return *this;
+        }
+        clear();
+        comp = other.comp;
+        if constexpr (std::allocator_traits<NodeAlloc>::propagate_on_container_move_assignment::value) {
+            nodeAlloc = std::move(other.nodeAlloc);
+        }
+        else if (!(nodeAlloc == other.nodeAlloc)) {
+            assignSorted(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+            other.clear();
+            return *this;
+        }
+        root = other.root;
+        other.root = nullptr;
+        return *this;
+    }
+
+    // Деструктор.
+    ~AVLTree() {
+        clear();
+    }
+
+    // Заменить содержимое дерева значениями из отсортированного по неубыванию диапазона [first, last).
+    // Дерево строится сразу сбалансированным за один проход, повторы отбрасываются по ходу построения.
+    // Нужны прямые итераторы: диапазон читается дважды (подсчет различных значений и построение). N | N | N
+    template<typename It>
+    void assignSorted(It first, It last) {
+        clear();
+        root = buildSorted(first, last, countDistinct(first, last));
+    }
+
+    // Заменить содержимое дерева значениями из произвольного диапазона [first, last). Отсортированный
+    // диапазон строится напрямую за линейное время, иначе значения копируются и сортируются. N | NLog2N | N
+    template<typename It>
+    void assign(It first, It last) {
+        using Category = typename std::iterator_traits<It>::iterator_category;
+        if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+            if (std::is_sorted(first, last, comp)) {
+                assignSorted(first, last);
+                return;
+            }
+        }
+        std::vector<T> values(first, last);
+        std::sort(values.begin(), values.end(), comp);
+        assignSorted(values.begin(), values.end());
+    }
+
+    // Вставка отсортированного по возрастанию диапазона [first, last); повторы и уже имеющиеся значения
+    // пропускаются. Короткий пакет собирается в сбалансированное дерево и объединяется с этим через
+    // split/join (unionNodes), длинный - слиянием с узлами дерева и перестройкой за линейное время
+    // (узлы имеющихся элементов не перемещаются). Возвращает число вставленных элементов.
+    // Неотсортированный диапазон - std::invalid_argument (дерево не меняется; проверка - еще один проход
+    // по пакету). Нужны прямые итераторы. M*Log2(N/M + 1) | M*Log2(N/M + 1) | N + M
+    template<typename It>
+    size_t insert_sorted(It first, It last) {
+        size_t batch = static_cast<size_t>(std::distance(first, last));
+        if (batch == 0) {
+            return 0;
+        }
+        if (!std::is_sorted(first, last, comp)) {
+            throw std::invalid_argument("insert_sorted: range is not sorted");
+        }
+        size_t before = size();
+        if (!preferRebuild(batch)) {
+            AVLTreeNode<T>* added = buildSorted(first, last, countDistinct(first, last));
+            setRoot(unionNodes(root, added, nodeAlloc));
+            return size() - before;
+        }
+
+        std::vector<AVLTreeNode<T>*> existing = collectNodes(before);
+        std::vector<AVLTreeNode<T>*> merged;
+        merged.reserve(before + batch);
+        size_t next = 0;
+        try {
+            for (; first != last; ++first) {
+                while (next < existing.size() && !comp(*first, existing[next]->n_data)) {
+                    merged.push_back(existing[next++]);
+                }
+                if (!merged.empty() && !comp(merged.back()->n_data, *first)) {
+                    continue; // Значение уже есть в дереве или повторяется в пакете
+                }
+                merged.push_back(newNode(std::in_place, *first));
+            }
+        }
+        catch (...) {
+            // Дерево еще не тронуто: освобождаем только новые узлы
+            size_t old = 0;
+            for (AVLTreeNode<T>* node : merged) {
+                if (old < existing.size() && node == existing[old]) {
+                    old++;
+                }
+                else {
+                    deleteNode(node);
+                }
+            }
+            throw;
+        }
+        merged.insert(merged.end(), existing.begin() + next, existing.end());
+        root = linkSorted(merged.data(), merged.size(), nullptr);
+        return merged.size() - before;
+    }
+
+    // Удаление значений отсортированного по возрастанию диапазона [first, last). Короткий пакет собирается
+    // во временное сбалансированное дерево и вычитается через split/join (differenceNodes), длинный -
+    // одним проходом по узлам дерева с перестройкой. Возвращает число удаленных элементов.
+    // Неотсортированный диапазон - std::invalid_argument, как в insert_sorted. Нужны прямые итераторы.
+    // M*Log2(N/M + 1) | M*Log2(N/M + 1) | N
+    template<typename It>
+    size_t erase_sorted(It first, It last) {
+        size_t batch = static_cast<size_t>(std::distance(first, last));
+        if (batch == 0) {
+            return 0;
+        }
+        if (!std::is_sorted(first, last, comp)) {
+            throw std::invalid_argument("erase_sorted: range is not sorted");
+        }
+        if (root == nullptr) {
+            return 0;
+        }
+        size_t before = size();
+        if (!preferRebuild(batch)) {
+            AVLTreeNode<T>* removed = buildSorted(first, last, countDistinct(first, last));
+            setRoot(differenceNodes(root, removed, nodeAlloc));
+            return before - size();
+        }
+
+        std::vector<AVLTreeNode<T>*> nodes = collectNodes(before);
+        size_t kept = 0;
+        for (AVLTreeNode<T>* node : nodes) {
+            while (first != last && comp(*first, node->n_data)) {
+                ++first;
             }
-        }
-        else if (node->balanceFactor < -1) {
-            if (getHeight(node->getRight()->getRight()) >= getHeight(node->getRight()->getLeft())) {
-                //Одинарный левый поворот
-                node = rotateLeft(node);
+            if (first != last && !comp(node->n_data, *first)) {
+                deleteNode(node);
             }
             else {
-                //Большой левый поворот
-                node->n_right = rotateRight(node->getRight());
-                node = rotateLeft(node);
+                nodes[kept++] = node;
             }
         }
+        root = linkSorted(nodes.data(), kept, nullptr);
+        return before - kept;
+    }
 
-        return node;
+    // Отделение элементов, не меньших key, в новое дерево (split). В этом дереве остаются элементы меньше key.
+    // Узлы не копируются, а перевязываются. Log2N | Log2N | Log2N
+    AVLTree split_off(const T& key) {
+        AVLTreeNode<T>* less;
+        AVLTreeNode<T>* equal;
+        AVLTreeNode<T>* greater;
+        splitNodes(root, key, less, equal, greater);
+        root = less;
+        AVLTree result(comp, nodeAlloc);
+        result.root = equal != nullptr ? joinNodes(nullptr, equal, greater) : greater;
+        return result;
     }
 
-    // Функция для вставки узла в дерево.
-    AVLTreeNode<T>* insertNode(AVLTreeNode<T>* node, const T& data) {
-        if (node == nullptr) {
-            return new AVLTreeNode<T>(data);
+    // Присоединение справа дерева right, все элементы которого больше элементов этого дерева (join).
+    // right становится пустым. Бросает исключение, если деревья перекрываются. Log2N | Log2N | Log2N
+    void join(AVLTree&& right) {
+        if (root != nullptr && right.root != nullptr
+            && !comp(rightmostNode<T>(root)->n_data, leftmostNode<T>(right.root)->n_data)) {
+            throw std::invalid_argument("Trees overlap");
         }
+        AVLTree adopted = adoptable(std::move(right));
+        root = joinNodes(root, adopted.root);
+        adopted.root = nullptr;
+    }
 
-        if (data < node->n_data) {
-            node->n_left = insertNode(node->getLeft(), data);
-        }
-        else if (data > node->n_data) {
-            node->n_right = insertNode(node->getRight(), data);
-        }
+    // Объединение с other: узлы other перевешиваются в это дерево (при разных распределителях - перемещаются
+    // значения), other становится пустым. M*Log2(N/M + 1) | M*Log2(N/M + 1) | Log2N, M <= N - размеры деревьев
+    void union_with(AVLTree&& other) {
+        AVLTree adopted = adoptable(std::move(other));
+        setRoot(unionNodes(root, adopted.root, adopted.nodeAlloc));
+        adopted.root = nullptr;
+    }
 
+    // Пересечение с other: остаются узлы этого дерева, чьи значения есть в other; other становится пустым.
+    // M*Log2(N/M + 1) | M*Log2(N/M + 1) | Log2N
+    void intersect_with(AVLTree&& other) {
+        setRoot(intersectNodes(root, other.root, other.nodeAlloc));
+        other.root = nullptr;
+    }
 
+    // Разность с other: удаляются значения, которые есть в other; other становится пустым.
+    // M*Log2(N/M + 1) | M*Log2(N/M + 1) | Log2N
+    void difference_with(AVLTree&& other) {
+        setRoot(differenceNodes(root, other.root, other.nodeAlloc));
+        other.root = nullptr;
+    }
 
-        return balanceTree(node);
+    // Параллельные варианты на пуле потоков pool (см. WorkStealingPool.h). С распределителем, который
+    // нельзя использовать из нескольких потоков (IsThreadSafeAllocator), выполняются последовательно.
+    // Работа M*Log2(N/M + 1), глубина Log2N * Log2M
+    void union_with(AVLTree&& other, WorkStealingPool& pool) {
+        applySetParallel(SetOperation::Union, adoptable(std::move(other)), pool);
     }
-    // Функция для удаления узла из дерева.
-    AVLTreeNode<T>* deleteNode(AVLTreeNode<T>* node, const T& data) {
-        if (node == nullptr) {
-            return nullptr;
-        }
 
-        if (data < node->n_data) {
-            node->n_left = deleteNode(node->getLeft(), data);
-        }
-        else if (data > node->n_data) {
-            node->n_right = deleteNode(node->getRight(), data);
+    void intersect_with(AVLTree&& other, WorkStealingPool& pool) {
+        applySetParallel(SetOperation::Intersection, std::move(other), pool);
+    }
+
+    void difference_with(AVLTree&& other, WorkStealingPool& pool) {
+        applySetParallel(SetOperation::Difference, std::move(other), pool);
+    }
+
+    // Параллельное построение из отсортированного диапазона итераторов произвольного доступа. Повторы
+    // отбрасываются (для этого диапазон с повторами копируется). N | N | N, глубина Log2N
+    template<typename It>
+    void assignSorted(It first, It last, WorkStealingPool& pool) {
+        if constexpr (!PARALLEL_SAFE) {
+            assignSorted(first, last);
         }
         else {
-            if (node->getLeft() == nullptr) {
-                AVLTreeNode<T>* temp = node->getRight();
-                delete node;
-                return temp;
-            }
-            else if (node->getRight() == nullptr) {
-                AVLTreeNode<T>* temp = node->getLeft();
-                delete node;
-                return temp;
-            }
-
-            AVLTreeNode<T>* temp = node->getRight();
-            while (temp->getLeft() != nullptr) {
-                temp = temp->getLeft();
+            auto repeated = std::adjacent_find(first, last, [this](const T& a, const T& b) { return !comp(a, b); });
+            if (repeated != last) {
+                std::vector<T> unique;
+                unique.reserve(static_cast<size_t>(last - first));
+                std::unique_copy(first, last, std::back_inserter(unique), [this](const T& a, const T& b) { return !comp(a, b); });
+                assignSorted(unique.begin(), unique.end(), pool);
+                return;
             }
-
-            node->n_data = temp->n_data;
-            node->n_right = deleteNode(node->getRight(), temp->n_data);
+            clear();
+            size_t count = static_cast<size_t>(last - first);
+            AVLTreeNode<T>* built = nullptr;
+            pool.run([&] { built = buildSortedParallel(first, count, pool); });
+            root = built;
         }
+    }
 
-        return balanceTree(node);
+    // Варианты, не меняющие other: операция выполняется над его копией. N + M*Log2(N/M + 1) | ... | M
+    void union_with(const AVLTree& other) {
+        union_with(copyOf(other));
     }
 
-public:
-    // Конструктор по умолчанию.
-    AVLTree() : root(nullptr) {}
+    void intersect_with(const AVLTree& other) {
+        intersect_with(copyOf(other));
+    }
 
-    // Деструктор.
-    ~AVLTree() {
-        clear();
+    void difference_with(const AVLTree& other) {
+        difference_with(copyOf(other));
     }
 
-    // Функция для вставки элемента в дерево.
+    // Функция для вставки элемента в дерево. Итеративная: путь хранится в массиве на стеке. Log2N | Log2N | 1
     void insert(const T& data) {
-        root = insertNode(root, data);
+        insertUnique(data, data);
+    }
+
+    // Вставка перемещением: data переносится в узел, если такого элемента еще нет. Log2N | Log2N | 1
+    void insert(T&& data) {
+        insertUnique(data, std::move(data));
+    }
+
+    // Вставка элемента, создаваемого на месте из args (без копирования и перемещения T). Ключ известен
+    // только после создания, поэтому при повторе созданный узел освобождается.
+    // Возвращает узел с этим значением и признак вставки. Log2N | Log2N | 1
+    template<typename... Args>
+    std::pair<AVLTreeNode<T>*, bool> emplace(Args&&... args) {
+        AVLTreeNode<T>* node = newNode(std::in_place, std::forward<Args>(args)...);
+        AVLTreeNode<T>* path[MAX_HEIGHT];
+        int depth;
+        int order;
+        AVLTreeNode<T>* found = descend(node->n_data, path, depth, order);
+        if (found != nullptr) {
+            deleteNode(node);
+            return std::make_pair(found, false);
+        }
+        attachNode(path, depth, order, node);
+        return std::make_pair(node, true);
     }
 
-    // Функция для удаления элемента из дерева.
+    // Функция для удаления элемента из дерева. Узел с двумя детьми заменяется своим преемником
+    // перестановкой указателей, данные не копируются. Log2N | Log2N | 1
     void remove(const T& data) {
-        root = deleteNode(root, data);
+        removeKey(data);
+    }
+
+    // Удаление по ключу другого типа (для прозрачного компаратора). Log2N | Log2N | 1
+    template<typename Key> requires TransparentCompare<Compare>
+    void remove(const Key& key) {
+        removeKey(key);
     }
 
 
 
     // Метод для вывода дерева в виде строки.
-    template<typename T>
-    string toString() {
-        string result = "";
-        toStringHelper(root, result);
-        return result;
+    string toString() const {
+        std::ostringstream result;
+        write_to(result);
+        return result.str();
+    }
+
+    // Вывод элементов по возрастанию через пробел (как toString) в поток out; поток сбрасывается
+    // один раз в конце. N | N | Log2N
+    void write_to(std::ostream& out) const {
+        OutputBuffer buffer(out);
+        write_to(buffer);
+        buffer.flush();
+        out.flush();
+    }
+
+    // Вывод элементов по возрастанию через пробел в буфер. N | N | Log2N
+    void write_to(OutputBuffer& buffer) const {
+        writeInOrder<TreeNode<T>>(buffer, root);
     }
 
+    // Вывод дерева в виде дерева (как printTree) в поток out. N | N | Log2N
+    void write_tree_to(std::ostream& out) const {
+        OutputBuffer buffer(out);
+        write_tree_to(buffer);
+        buffer.flush();
+        out.flush();
+    }
 
+    void write_tree_to(OutputBuffer& buffer) const {
+        writeLayout<TreeNode<T>>(buffer, root, 2);
+    }
 
     // Метод для вывода дерева в виде дерева.
     void printTree() {
         if (root)
-            printTreeHelper(root, 0);
+            write_tree_to(std::cout);
     }
 
 
 
     // Метод для поиска элемента в дереве.
-    AVLTreeNode<T>* find(const T& data) {
-        return findHelper(root, data);
+    AVLTreeNode<T>* find(const T& data) const {
+        return findNodeKey(data);
+    }
+
+    // Поиск по ключу другого типа (для прозрачного компаратора).
+    template<typename Key> requires TransparentCompare<Compare>
+    AVLTreeNode<T>* find(const Key& key) const {
+        return findNodeKey(key);
     }
 
     //Метод поиска узла в дереве
-    AVLTreeNode<T>* findNode(const T& data) {
+    AVLTreeNode<T>* findNode(const T& data) const {
+        return findNodeKey(data);
+    }
+
+    // Поиск узла по ключу другого типа (для прозрачного компаратора).
+    template<typename Key> requires TransparentCompare<Compare>
+    AVLTreeNode<T>* findNode(const Key& key) const {
+        return findNodeKey(key);
+    }
+
+
+
+    // Пакетный поиск: out[i] = findNode(keys[i]). Поиски идут группами по BATCH_WIDTH вперемешку,
+    // поэтому промахи кэша разных ключей перекрываются. Бросает исключение, если out короче keys. KLog2N | KLog2N | 1
+    void find_batch(std::span<const T> keys, std::span<AVLTreeNode<T>*> out) const {
+        if (out.size() < keys.size()) {
+            throw std::invalid_argument("Output span is too small");
+        }
+        for (size_t first = 0; first < keys.size(); first += BATCH_WIDTH) {
+            findBatchGroup(keys.data() + first, out.data() + first, std::min(BATCH_WIDTH, keys.size() - first));
+        }
+    }
+
+    // Пакетная проверка наличия: бит i (bits[i / 64], разряд i % 64) равен 1, если keys[i] есть в дереве.
+    // Бросает исключение, если в bits меньше keys.size() бит. KLog2N | KLog2N | 1
+    void contains_batch(std::span<const T> keys, std::span<uint64_t> bits) const {
+        if (bits.size() * 64 < keys.size()) {
+            throw std::invalid_argument("Output span is too small");
+        }
+        std::fill(bits.begin(), bits.begin() + (keys.size() + 63) / 64, 0);
+        AVLTreeNode<T>* found[BATCH_WIDTH];
+        for (size_t first = 0; first < keys.size(); first += BATCH_WIDTH) {
+            size_t count = std::min(BATCH_WIDTH, keys.size() - first);
+            findBatchGroup(keys.data() + first, found, count);
+            for (size_t i = 0; i < count; i++) {
+                bits[(first + i) / 64] |= static_cast<uint64_t>(found[i] != nullptr) << ((first + i) % 64);
+            }
+        }
+    }
+
+    // Применить функцию-шаблон к каждому элементу в порядке order (по умолчанию по возрастанию). Вызов
+    // встраивается, обход итеративный по ссылкам на родителей. func не должна менять порядок элементов. N | N | 1
+    template<typename F>
+    void apply(F&& func, ApplyOrder order = ApplyOrder::Inorder) const {
+        applyOrdered<T>(root, func, order);
+    }
+
+    // Применить func к каждому элементу в threads потоках (func вызывается одновременно для разных элементов
+    // и не должна менять их порядок). Дерево режется по хранимым размерам на поддеревья примерно по
+    // N / (threads * CHUNKS_PER_THREAD) узлов; порядок внутри поддеревьев - order (см. ApplyOrder). N | N/P | P
+    template<typename F>
+    void parallel_for_each(F&& func, size_t threads = std::thread::hardware_concurrency(), ApplyOrder order = ApplyOrder::Preorder) {
+        threads = std::max<size_t>(threads, 1);
+        vector<TreeNode<T>*> tops;
+        vector<TreeNode<T>*> chunks;
+        size_t chunkSize = std::max<size_t>(1, size() / (threads * BinarySearchTree<T>::CHUNKS_PER_THREAD));
+        splitForParallel(root, chunkSize, tops, chunks);
+        applyParallel(tops, chunks, func, order, threads);
+    }
+
+    // То же на потоках пула pool (см. WorkStealingPool.h): потоки не создаются на каждый вызов. N | N/P | P
+    template<typename F>
+    void parallel_for_each(F&& func, WorkStealingPool& pool, ApplyOrder order = ApplyOrder::Preorder) {
+        vector<TreeNode<T>*> tops;
+        vector<TreeNode<T>*> chunks;
+        size_t chunkSize = std::max<size_t>(1, size() / (pool.size() * BinarySearchTree<T>::CHUNKS_PER_THREAD));
+        splitForParallel(root, chunkSize, tops, chunks);
+        applyParallel(tops, chunks, func, order, pool);
+    }
+
+    // Число элементов в дереве. O(1)
+    size_t size() const {
+        return getSize(root);
+    }
+
+    // Проверка на пустоту дерева. O(1)
+    bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // Узел с k-м по возрастанию значением (нумерация с 0), nullptr если k >= size(). Log2N | Log2N | 1
+    AVLTreeNode<T>* selectNode(size_t k) const {
         AVLTreeNode<T>* current = root;
         while (current != nullptr) {
-            if (data < current->n_data) {
+            size_t leftSize = getSize(current->getLeft());
+            if (k < leftSize) {
                 current = current->getLeft();
             }
-            else if (data > current->n_data) {
-                current = current->getRight();
+            else if (k == leftSize) {
+                return current;
             }
             else {
-                return current; // Найдено
+                k -= leftSize + 1;
+                current = current->getRight();
             }
         }
-        return nullptr; // Не найдено
+        return nullptr;
+    }
+
+    // k-е по возрастанию значение (нумерация с 0). Бросает исключение, если k >= size(). Log2N | Log2N | 1
+    const T& select(size_t k) const {
+        AVLTreeNode<T>* node = selectNode(k);
+        if (node == nullptr) {
+            throw out_of_range("Index out of range");
+        }
+        return node->n_data;
+    }
+
+    // Число элементов, меньших data (позиция data в отсортированном порядке). Log2N | Log2N | 1
+    size_t rank(const T& data) const {
+        return rankKey(data);
+    }
+
+    // Число элементов, меньших key другого типа (для прозрачного компаратора). Log2N | Log2N | 1
+    template<typename Key> requires TransparentCompare<Compare>
+    size_t rank(const Key& key) const {
+        return rankKey(key);
+    }
+
+    // Высота дерева (пустое дерево имеет высоту 0). O(1)
+    int getTreeHeight() const {
+        return getHeight(root);
     }
 
+    // Проверка согласованности хранимых высот и коэффициентов баланса (для тестов). N | N | N
+    bool checkHeights() const {
+        return checkHeightsHelper(root) >= 0;
+    }
 
+    // Проверка согласованности родительских указателей (для тестов). N | N | N
+    bool checkParents() const {
+        return (root == nullptr || root->n_parent == nullptr) && checkParentsHelper(root);
+    }
 
     // Метод для доступа к коэффициенту баланса узла по узлу.
     int getBalanceFactorNode(AVLTreeNode<T>* node) {
@@ -292,43 +1517,72 @@ public:
     }
 
 
-    //Класс Итератор для AVLTreeNode (LNR, Inorder)
+    //Класс Итератор для AVLTreeNode (LNR, Inorder). Двунаправленный: ходит по родительским указателям,
+    //хранит только текущий узел и корень (для шага назад от конца), ничего не выделяет.
     class Iterator {
     private:
+        friend class AVLTree;
+
         AVLTreeNode<T>* root;
-        stack<AVLTreeNode<T>*> nodeStack;
+        AVLTreeNode<T>* node;
+#ifdef AVLTREE_STATS
+        // Счетчики дерева, учитывающие шаги (nullptr - не учитывать)
+        TreeCounters* counters = nullptr;
+#endif
 
     public:
-        // Конструктор итератора
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        // Конструктор по умолчанию (итератор ни на что не указывает)
+        Iterator() : root(nullptr), node(nullptr) {}
+
+        // Конструктор итератора, стоящего на первом элементе
         Iterator(AVLTreeNode<T>* n_root) {
             root = n_root;
-            pushLeftBranch(n_root);
+            node = static_cast<AVLTreeNode<T>*>(leftmostNode<T>(n_root));
         }
 
+        // Конструктор итератора, стоящего на узле n_node (nullptr - конец)
+        Iterator(AVLTreeNode<T>* n_root, AVLTreeNode<T>* n_node) : root(n_root), node(n_node) {}
+
         // Оператор проверки на неравенства
         bool operator!=(const Iterator& other) const {
-            return !(hasNext() == false && other.hasNext() == false);
+            return node != other.node;
         }
 
         // Оператор проверки на равенства
         bool operator==(const Iterator& other) const {
-            return nodeStack.empty() == other.nodeStack.empty();
+            return node == other.node;
         }
 
         // Проверка есть ли следующий элемент
         bool hasNext() const {
 
-            return !nodeStack.empty();
+            return node != nullptr;
         }
 
         // Оператор разыменования
         T& operator*() const {
-            return nodeStack.top()->n_data;
+            return node->n_data;
+        }
+
+        // Доступ к полям элемента
+        T* operator->() const {
+            return &node->n_data;
         }
 
         // Получение информации 
         T& data() {
-            return nodeStack.top()->n_data;
+            return node->n_data;
+        }
+
+        // Узел, на котором стоит итератор (nullptr - конец)
+        AVLTreeNode<T>* getNode() const {
+            return node;
         }
 
         // Оператор инкремента
@@ -336,52 +1590,229 @@ public:
             return next();
         }
 
+        // Постфиксный инкремент
+        Iterator operator++(int) {
+            Iterator old = *this;
+            next();
+            return old;
+        }
+
+        // Оператор декремента
+        Iterator& operator--() {
+            return prev();
+        }
+
+        // Постфиксный декремент
+        Iterator operator--(int) {
+            Iterator old = *this;
+            prev();
+            return old;
+        }
+
         // Сброс итератора
         void reset() {
-            while (!nodeStack.empty())
-                nodeStack.pop();
-            pushLeftBranch(root);
+            node = static_cast<AVLTreeNode<T>*>(leftmostNode<T>(root));
         }
 
-        // Переход к следующему элементы
+        // Переход к следующему элементы. 1 амортизированно | Log2N | 1
         Iterator& next() {
-            AVLTreeNode<T>* currentNode;
             if (!hasNext()) {
                 throw std::out_of_range("No more elements in the iterator");
             }
-            currentNode = nodeStack.top();
-            nodeStack.pop();
-            pushLeftBranch(currentNode->getRight());
+#ifdef AVLTREE_STATS
+            uint64_t hops = 0;
+            node = static_cast<AVLTreeNode<T>*>(inorderNext<T>(node, CountHops{ hops }));
+            if (counters != nullptr) {
+                counters->recordStep(hops);
+            }
+#else
+            node = static_cast<AVLTreeNode<T>*>(inorderNext<T>(node));
+#endif
             return *this;
         }
 
-    private:
-        // Метод помещающий все левые узлы узла node в nodeStack
-        void pushLeftBranch(AVLTreeNode<T>* node) {
-            while (node != nullptr) {
-                nodeStack.push(node);
-                node = node->getLeft();
+        // Переход к предыдущему элементу; от конца - к последнему. 1 амортизированно | Log2N | 1
+        Iterator& prev() {
+#ifdef AVLTREE_STATS
+            uint64_t hops = 0;
+            TreeNode<T>* previous = node == nullptr ? rightmostNode<T>(root, CountHops{ hops }) : inorderPrev<T>(node, CountHops{ hops });
+#else
+            TreeNode<T>* previous = node == nullptr ? rightmostNode<T>(root) : inorderPrev<T>(node);
+#endif
+            if (previous == nullptr) {
+                throw std::out_of_range("No previous elements in the iterator");
             }
+            node = static_cast<AVLTreeNode<T>*>(previous);
+            AVLTREE_STAT(if (counters != nullptr) { counters->recordStep(hops); });
+            return *this;
         }
     };
 
+private:
+    // Итератор дерева на узле node (nullptr - конец); при AVLTREE_STATS его шаги учитываются в счетчиках дерева
+    Iterator iteratorAt(AVLTreeNode<T>* node) const {
+        Iterator result(root, node);
+        AVLTREE_STAT(result.counters = &counters);
+        return result;
+    }
+
+public:
+
+    // Обратный итератор (RNL)
+    using ReverseIterator = std::reverse_iterator<Iterator>;
+
     // возвращает итератор на начало дерева
     Iterator begin() const {
-        return Iterator(root);
+        return iteratorAt(static_cast<AVLTreeNode<T>*>(leftmostNode<T>(root)));
     }
 
     // Переносит итератор на конец дерева
     Iterator end() const {
-        return Iterator(nullptr);
+        return iteratorAt(nullptr);
+    }
+
+    // Обратный итератор на последнем элементе
+    ReverseIterator rbegin() const {
+        return ReverseIterator(end());
+    }
+
+    // Обратный итератор перед первым элементом
+    ReverseIterator rend() const {
+        return ReverseIterator(begin());
+    }
+
+    // Итератор на элементе с номером index в порядке возрастания. Log2N | Log2N | 1
+    Iterator nth(size_t index) const {
+        return iteratorAt(selectNode(index));
+    }
+
+    // Итератор на первом элементе, не меньшем key. Log2N | Log2N | 1
+    Iterator lower_bound(const T& key) const {
+        return iteratorAt(boundNode(key, false));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    Iterator lower_bound(const Key& key) const {
+        return iteratorAt(boundNode(key, false));
+    }
+
+    // Итератор на первом элементе, большем key. Log2N | Log2N | 1
+    Iterator upper_bound(const T& key) const {
+        return iteratorAt(boundNode(key, true));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    Iterator upper_bound(const Key& key) const {
+        return iteratorAt(boundNode(key, true));
+    }
+
+    // Пара итераторов [lower_bound(key), upper_bound(key)). Log2N | Log2N | 1
+    std::pair<Iterator, Iterator> equal_range(const T& key) const {
+        return std::make_pair(lower_bound(key), upper_bound(key));
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    std::pair<Iterator, Iterator> equal_range(const Key& key) const {
+        return std::make_pair(lower_bound(key), upper_bound(key));
+    }
+
+    // Узел с наибольшим значением, не большим key, или nullptr. Log2N | Log2N | 1
+    AVLTreeNode<T>* floor(const T& key) const {
+        return floorNode(key);
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    AVLTreeNode<T>* floor(const Key& key) const {
+        return floorNode(key);
+    }
+
+    // Узел с наименьшим значением, не меньшим key, или nullptr. Log2N | Log2N | 1
+    AVLTreeNode<T>* ceiling(const T& key) const {
+        return boundNode(key, false);
+    }
+
+    template<typename Key> requires TransparentCompare<Compare>
+    AVLTreeNode<T>* ceiling(const Key& key) const {
+        return boundNode(key, false);
+    }
+
+    // Представление элементов из полуинтервала [lo, hi) для обхода в цикле for.
+    // Обе границы находятся за Log2N, дальше выдаются только попавшие в интервал элементы.
+    class Range {
+    public:
+        Range(const Iterator& n_first, const Iterator& n_last, size_t n_count) : first(n_first), last(n_last), count(n_count) {}
+
+        Iterator begin() const {
+            return first;
+        }
+
+        Iterator end() const {
+            return last;
+        }
+
+        // Число элементов в интервале (считается по размерам поддеревьев). 1 | 1 | 1
+        size_t size() const {
+            return count;
+        }
+
+    private:
+        Iterator first;
+        Iterator last;
+        size_t count;
+    };
+
+    // Элементы из полуинтервала [lo, hi). Log2N + K | Log2N + K | 1
+    Range range(const T& lo, const T& hi) const {
+        if (!comp(lo, hi)) {
+            return Range(end(), end(), 0);
+        }
+        return Range(lower_bound(lo), lower_bound(hi), rank(hi) - rank(lo));
+    }
+
+    // Неизменяемый снимок для поиска без указателей (массив в порядке Эйтцингера). Дерево после
+    // снимка можно менять: снимок хранит копии элементов. N | N | N
+    FrozenAVLTree<T, Compare> freeze() const {
+        return FrozenAVLTree<T, Compare>(begin(), size(), comp);
+    }
+
+    // Снимок числовых ключей с векторным поиском внутри блоков (только для порядка std::less). N | N | N
+    FrozenKeyBlocks<T> freezeBlocks(SimdLevel maxLevel = SimdLevel::AVX2) const requires (std::is_arithmetic<T>::value && IsStdLess<Compare>::value) {
+        return FrozenKeyBlocks<T>(begin(), size(), maxLevel);
     }
+    // Очистка дерева. Для арены (ArenaAllocator) и тривиально разрушаемых T - 1 | 1 | 1, иначе N | N | N
     void clear() {
         if (root)
         {
-            clearNode(root);
+            AVLTREE_STAT(size_t released = getSize(root)); // После releaseAllNodes узлы уже недоступны
+            if (std::is_trivially_destructible<T>::value && releaseAllNodes(nodeAlloc)) {
+                AVLTREE_STAT(counters.countFrees(released));
+            }
+            else {
+                clearNode(root);
+            }
             root = nullptr;
         }
     }
 
+    // Копия распределителя дерева. 1 | 1 | 1
+    Alloc get_allocator() const {
+        return Alloc(nodeAlloc);
+    }
+
+    // Снимок счетчиков операций; без AVLTREE_STATS - нули (см. TreeStats.h). 1 | 1 | 1
+    TreeStats stats() const {
+#ifdef AVLTREE_STATS
+        return counters.snapshot();
+#else
+        return TreeStats();
+#endif
+    }
+
+    // Обнуление счетчиков операций. 1 | 1 | 1
+    void resetStats() {
+        AVLTREE_STAT(counters.reset());
+    }
+
     // тестирование
     static void AVLTreeRunTest() {
         AVLTree<int> tree;
@@ -517,6 +1948,597 @@ public:
         }
         tree.clear();
 
+        // Хранимые высоты после последовательной вставки и удаления
+        for (int k = 0; k < 1000; k++) {
+            tree.insert(k);
+        }
+        assert(tree.checkHeights());
+        assert(tree.getTreeHeight() <= 15); // 1.44 * log2(1000)
+        for (int k = 0; k < 1000; k += 3) {
+            tree.remove(k);
+        }
+        assert(tree.checkHeights());
+        assert(tree.find(3) == nullptr);
+        assert(tree.find(4) != nullptr);
+        tree.clear();
+        assert(tree.getTreeHeight() == 0);
+
+        // Удаление узлов с двумя детьми в случайном порядке сохраняет порядок и баланс
+        for (int k = 0; k < 512; k++) {
+            tree.insert((k * 37) % 512);
+        }
+        for (int k = 0; k < 512; k += 2) {
+            tree.remove((k * 101) % 512);
+        }
+        assert(tree.checkHeights());
+        int expected = 0;
+        for (int value : tree) {
+            assert(value == expected * 2 + 1);
+            expected++;
+        }
+        assert(expected == 256);
+        tree.clear();
+
+        // Распределители узлов: пул, арена и pmr
+        AVLTree<int, NodePoolAllocator<int>> poolTree;
+        AVLTree<int, ArenaAllocator<int>> arenaTree;
+        std::pmr::monotonic_buffer_resource resource;
+        AVLTree<int, std::pmr::polymorphic_allocator<int>> pmrTree{ std::pmr::polymorphic_allocator<int>(&resource) };
+        for (int k = 0; k < 2000; k++) {
+            poolTree.insert((k * 7) % 2000);
+            arenaTree.insert((k * 7) % 2000);
+            pmrTree.insert((k * 7) % 2000);
+        }
+        for (int k = 0; k < 2000; k += 2) {
+            poolTree.remove(k);
+            arenaTree.remove(k);
+            pmrTree.remove(k);
+        }
+        assert(poolTree.checkHeights() && arenaTree.checkHeights() && pmrTree.checkHeights());
+        assert(poolTree.find(1) != nullptr && arenaTree.find(1999) != nullptr && pmrTree.find(2) == nullptr);
+        poolTree.clear();
+        arenaTree.clear();
+        pmrTree.clear();
+        assert(arenaTree.begin() == arenaTree.end());
+        arenaTree.insert(5);
+        assert(arenaTree.find(5) != nullptr);
+
+        // Перемещение передает распределитель: у арены остается один владелец, и clear отдает ее разом;
+        // перемещенное дерево заводит новую арену
+        AVLTree<int, ArenaAllocator<int>> movedArena(std::move(arenaTree));
+        assert(movedArena.find(5) != nullptr && movedArena.get_allocator().arena.use_count() == 2);
+        arenaTree.insert(6);
+        assert(arenaTree.size() == 1 && arenaTree.get_allocator() != movedArena.get_allocator());
+        arenaTree = std::move(movedArena);
+        assert(arenaTree.find(5) != nullptr && arenaTree.find(6) == nullptr && movedArena.isEmpty());
+        assert(arenaTree.get_allocator().arena.use_count() == 2);
+        arenaTree.clear();
+
+        // pmr не передает распределитель при присваивании: при том же ресурсе узлы перевешиваются,
+        // при другом элементы переезжают в узлы своего ресурса
+        std::pmr::monotonic_buffer_resource otherResource;
+        AVLTree<int, std::pmr::polymorphic_allocator<int>> samePmr{ std::pmr::polymorphic_allocator<int>(&resource) };
+        AVLTree<int, std::pmr::polymorphic_allocator<int>> otherPmr{ std::pmr::polymorphic_allocator<int>(&otherResource) };
+        for (int k = 0; k < 100; k++) {
+            samePmr.insert(k);
+            otherPmr.insert(k * 2);
+        }
+        const int* sameFirst = &*samePmr.begin();
+        pmrTree = std::move(samePmr);
+        assert(&*pmrTree.begin() == sameFirst && samePmr.isEmpty());
+        pmrTree = std::move(otherPmr);
+        assert(otherPmr.isEmpty() && pmrTree.size() == 100 && pmrTree.checkHeights() && pmrTree.checkParents());
+        assert(pmrTree.find(198) != nullptr && pmrTree.get_allocator().resource() == &resource);
+        AVLTree<int, std::pmr::polymorphic_allocator<int>> movedPmr(std::move(pmrTree));
+        assert(movedPmr.size() == 100 && movedPmr.get_allocator().resource() == &resource);
+
+        // Построение из отсортированного и неотсортированного диапазонов
+        vector<int> sorted;
+        for (int k = 0; k < 1000; k++) {
+            sorted.push_back(k);
+        }
+        AVLTree<int> built(sorted.begin(), sorted.end());
+        static_assert(!std::is_constructible<AVLTree<int>, int, int>::value, "два числа - не диапазон итераторов");
+        assert(built.checkHeights());
+        assert(built.getTreeHeight() == 10);
+        expected = 0;
+        for (int value : built) {
+            assert(value == expected);
+            expected++;
+        }
+        assert(expected == 1000);
+        vector<int> unsorted = { 5, 3, 9, 3, 1, 5, 7, 9, 9 };
+        built.assign(unsorted.begin(), unsorted.end());
+        assert(built.checkHeights());
+        right = { 1, 3, 5, 7, 9 };
+        i = 0;
+        for (int value : built) {
+            assert(value == right[i]);
+            i++;
+        }
+        assert(i == right.size());
+        vector<int> withDuplicates = { 1, 1, 2, 2, 2, 3, 4, 4 };
+        built.assignSorted(withDuplicates.begin(), withDuplicates.end());
+        assert(built.checkHeights());
+        assert(built.find(4) != nullptr && built.find(5) == nullptr);
+        built.assign(withDuplicates.end(), withDuplicates.end());
+        assert(built.begin() == built.end());
+
+        // Порядковая статистика: size, select, rank и доступ итератора по номеру
+        assert(built.size() == 0 && built.isEmpty());
+        for (int k = 0; k < 300; k++) {
+            built.insert((k * 17) % 300 * 2);
+        }
+        built.insert(34); // Повтор не меняет размер
+        assert(built.size() == 300);
+        for (int k = 0; k < 300; k += 3) {
+            built.remove(k * 2);
+        }
+        built.remove(1); // Отсутствующий элемент не меняет размер
+        assert(built.size() == 200);
+        assert(built.checkHeights());
+        for (size_t k = 0; k < built.size(); k++) {
+            int value = built.select(k);
+            assert(built.rank(value) == k);
+            assert(*built.nth(k) == value);
+        }
+        assert(built.select(0) == 2 && built.select(1) == 4 && built.select(2) == 8);
+        assert(built.rank(5) == 2 && built.rank(-1) == 0 && built.rank(1000) == 200);
+        assert(built.selectNode(200) == nullptr);
+        assert(built.nth(200) == built.end());
+        try {
+            built.select(200);
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+        AVLTree<int>::Iterator fromMiddle = built.nth(198);
+        ++fromMiddle;
+        ++fromMiddle;
+        assert(fromMiddle == built.end());
+
+        // Поиск границ и обход интервала. В дереве четные числа 0..598, кроме кратных 6
+        assert(*built.lower_bound(4) == 4 && *built.lower_bound(5) == 8 && *built.lower_bound(6) == 8);
+        assert(*built.upper_bound(4) == 8 && *built.upper_bound(-10) == 2);
+        assert(built.lower_bound(599) == built.end() && built.upper_bound(598) == built.end());
+        assert(*built.equal_range(10).first == 10 && *built.equal_range(10).second == 14);
+        assert(built.floor(7)->n_data == 4 && built.floor(8)->n_data == 8 && built.floor(1) == nullptr);
+        assert(built.ceiling(7)->n_data == 8 && built.ceiling(8)->n_data == 8 && built.ceiling(599) == nullptr);
+        right = { 10, 14, 16, 20 };
+        i = 0;
+        for (int value : built.range(9, 22)) {
+            assert(value == right[i]);
+            i++;
+        }
+        assert(i == right.size() && built.range(9, 22).size() == right.size());
+        assert(built.range(22, 9).size() == 0 && !(built.range(22, 9).begin() != built.range(22, 9).end()));
+        i = 0;
+        for (int value : built.range(590, 10000)) {
+            assert(value >= 590);
+            i++;
+        }
+        assert(i == 4); // 590, 592, 596, 598
+
+        // Двунаправленный итератор и обход в обратном порядке
+        vector<int> forward(built.begin(), built.end());
+        vector<int> backward(built.rbegin(), built.rend());
+        std::reverse(backward.begin(), backward.end());
+        assert(forward == backward && forward.size() == 200);
+        AVLTree<int>::Iterator last = built.end();
+        --last;
+        assert(*last == 598);
+        last--;
+        assert(*last == 596);
+        AVLTree<int>::Iterator afterFirst = built.begin();
+        afterFirst++;
+        assert(*--afterFirst == 2 && afterFirst == built.begin());
+        try {
+            --afterFirst;
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+        AVLTree<int>::Iterator copied = built.lower_bound(300);
+        AVLTree<int>::Iterator step = copied;
+        ++step;
+        assert(copied != step && *copied == 302 && *step == 304);
+        for (int k = 0; k < 600; k += 4) {
+            built.remove(k);
+        }
+        assert(built.checkParents() && built.checkHeights());
+        assert(vector<int>(built.rbegin(), built.rend()).size() == built.size());
+
+        // Вставка перемещением и создание на месте
+        AVLTree<std::string> strings;
+        std::string moved = "moved string that does not fit into the small buffer";
+        strings.insert(std::move(moved));
+        assert(moved.empty() && strings.size() == 1);
+        assert(strings.emplace(5, 'x').second && strings.findNode("xxxxx") != nullptr);
+        assert(!strings.emplace("xxxxx").second && strings.size() == 2);
+
+        // Элементы без копирования: уникальные указатели, упорядоченные по значению
+        struct DerefLess {
+            bool operator()(const std::unique_ptr<int>& a, const std::unique_ptr<int>& b) const {
+                return *a < *b;
+            }
+        };
+        AVLTree<std::unique_ptr<int>, std::allocator<std::unique_ptr<int>>, DerefLess> owners;
+        for (int k = 0; k < 50; k++) {
+            owners.insert(std::make_unique<int>(k));
+            owners.emplace(new int(k + 50));
+        }
+        assert(owners.size() == 100 && owners.checkHeights());
+
+        // Удаление перестановкой узлов: узлы остальных элементов не перемещаются
+        AVLTreeNode<std::unique_ptr<int>>* successorNode = owners.selectNode(51);
+        owners.remove(owners.select(50));
+        assert(owners.selectNode(50) == successorNode && *successorNode->n_data == 51);
+        assert(owners.size() == 99 && owners.checkHeights() && owners.checkParents());
+
+        // Снимок дает те же ответы, что и дерево, и не зависит от его последующих изменений
+        AVLTree<int> source;
+        for (int k = 0; k < 1000; k += 3) {
+            source.insert(k);
+        }
+        FrozenAVLTree<int> frozen = source.freeze();
+        assert(frozen.size() == source.size());
+        for (int key = -2; key < 1002; key++) {
+            AVLTreeNode<int>* bound = source.lower_bound(key).getNode();
+            const int* frozenBound = frozen.lower_bound(key);
+            assert((bound == nullptr) == (frozenBound == nullptr));
+            assert(bound == nullptr || bound->n_data == *frozenBound);
+            assert(frozen.contains(key) == (source.findNode(key) != nullptr));
+        }
+        FrozenKeyBlocks<int> blocks = source.freezeBlocks();
+        for (int key = -2; key < 1002; key++) {
+            assert(blocks.contains(key) == frozen.contains(key));
+        }
+        source.clear();
+        assert(frozen.contains(999) && frozen.size() == 334 && blocks.contains(999));
+
+        // Пакетный поиск совпадает с поиском по одному ключу (в том числе для пустого дерева)
+        AVLTree<int> batchTree;
+        std::vector<int> batchKeys;
+        for (int k = -5; k < 300; k++) {
+            batchKeys.push_back(k * 7 % 251);
+        }
+        std::vector<AVLTreeNode<int>*> batchOut(batchKeys.size());
+        std::vector<uint64_t> batchBits((batchKeys.size() + 63) / 64, ~0ULL);
+        batchTree.find_batch(batchKeys, batchOut);
+        assert(std::count(batchOut.begin(), batchOut.end(), nullptr) == static_cast<long>(batchOut.size()));
+        for (int k = 0; k < 200; k += 2) {
+            batchTree.insert(k);
+        }
+        batchTree.find_batch(batchKeys, batchOut);
+        batchTree.contains_batch(batchKeys, batchBits);
+        for (size_t i = 0; i < batchKeys.size(); i++) {
+            assert(batchOut[i] == batchTree.findNode(batchKeys[i]));
+            assert(((batchBits[i / 64] >> (i % 64)) & 1) == (batchOut[i] != nullptr));
+        }
+        try {
+            batchTree.find_batch(batchKeys, std::span<AVLTreeNode<int>*>(batchOut.data(), 3));
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+
+        // Пакетная вставка и удаление отсортированных диапазонов: короткий пакет (split/join)
+        // и длинный (слияние с перестройкой) дают то же дерево, что и поэлементные операции
+        for (size_t batch : { size_t(5), size_t(40), size_t(3000) }) {
+            AVLTree<int> sortedTree;
+            std::set<int> model;
+            for (int k = 0; k < 2000; k += 3) {
+                sortedTree.insert(k);
+                model.insert(k);
+            }
+            AVLTreeNode<int>* stable = sortedTree.findNode(999);
+            std::vector<int> delta;
+            for (size_t k = 0; k < batch; k++) {
+                delta.push_back(static_cast<int>(k * 2000 / batch) - 7);
+                delta.push_back(static_cast<int>(k * 2000 / batch) - 7); // повторы в пакете
+            }
+            size_t added = sortedTree.insert_sorted(delta.begin(), delta.end());
+            size_t expectedAdded = 0;
+            for (int key : delta) {
+                expectedAdded += model.insert(key).second;
+            }
+            assert(added == expectedAdded && sortedTree.size() == model.size());
+            assert(sortedTree.checkHeights() && sortedTree.checkParents());
+            assert(std::equal(sortedTree.begin(), sortedTree.end(), model.begin(), model.end()));
+            assert(sortedTree.findNode(999) == stable);
+
+            std::vector<int> gone;
+            for (int k = -10; k < 2100; k += batch > 1000 ? 1 : 5) {
+                gone.push_back(k);
+            }
+            gone.resize(std::min(gone.size(), batch));
+            assert((gone.size() >= sortedTree.size()) == (batch > 1000)); // длинный пакет - перестройка
+            size_t erased = sortedTree.erase_sorted(gone.begin(), gone.end());
+            size_t expectedErased = 0;
+            for (int key : gone) {
+                expectedErased += model.erase(key);
+            }
+            assert(erased == expectedErased && sortedTree.size() == model.size());
+            assert(sortedTree.checkHeights() && sortedTree.checkParents());
+            assert(std::equal(sortedTree.begin(), sortedTree.end(), model.begin(), model.end()));
+
+            // Пакет по убыванию отвергается в обоих путях, дерево не меняется
+            std::reverse(delta.begin(), delta.end());
+            std::reverse(gone.begin(), gone.end());
+            try {
+                sortedTree.insert_sorted(delta.begin(), delta.end());
+                assert(false);
+            }
+            catch (const std::invalid_argument&) {}
+            try {
+                sortedTree.erase_sorted(gone.begin(), gone.end());
+                assert(false);
+            }
+            catch (const std::invalid_argument&) {}
+            assert(std::equal(sortedTree.begin(), sortedTree.end(), model.begin(), model.end()));
+        }
+
+        // Соединение и разрезание: деревья разной высоты, узлы сохраняют адреса
+        for (int split = -1; split <= 301; split += 15) {
+            AVLTree<int> whole;
+            for (int k = 0; k < 300; k += 2) {
+                whole.insert(k);
+            }
+            AVLTreeNode<int>* node100 = whole.findNode(100);
+            AVLTree<int> upper = whole.split_off(split);
+            assert(whole.checkHeights() && whole.checkParents() && upper.checkHeights() && upper.checkParents());
+            assert(whole.size() + upper.size() == 150);
+            assert(whole.isEmpty() || *whole.rbegin() < split);
+            assert(upper.isEmpty() || *upper.begin() >= split);
+            whole.join(std::move(upper));
+            assert(upper.isEmpty() && whole.size() == 150 && whole.checkHeights() && whole.checkParents());
+            assert(whole.findNode(100) == node100 && whole.select(75) == 150);
+        }
+        AVLTree<int> tall;
+        AVLTree<int> shortTree;
+        for (int k = 0; k < 1000; k++) {
+            tall.insert(k);
+        }
+        shortTree.insert(5000);
+        tall.join(std::move(shortTree));
+        assert(tall.size() == 1001 && tall.checkHeights() && tall.checkParents());
+        AVLTree<int> overlapping;
+        overlapping.insert(10);
+        try {
+            tall.join(std::move(overlapping));
+            assert(false);
+        }
+        catch (const std::invalid_argument&) {
+        }
+
+        // Объединение, пересечение и разность против std::set_*
+        std::mt19937 setRng(2024);
+        for (int round = 0; round < 20; round++) {
+            std::set<int> first;
+            std::set<int> second;
+            int firstCount = static_cast<int>(setRng() % 500);
+            int secondCount = round % 2 == 0 ? static_cast<int>(setRng() % 20) : static_cast<int>(setRng() % 500);
+            for (int k = 0; k < firstCount; k++) {
+                first.insert(static_cast<int>(setRng() % 1000));
+            }
+            for (int k = 0; k < secondCount; k++) {
+                second.insert(static_cast<int>(setRng() % 1000));
+            }
+            std::vector<int> expectedUnion;
+            std::vector<int> expectedIntersection;
+            std::vector<int> expectedDifference;
+            std::set_union(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedUnion));
+            std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedIntersection));
+            std::set_difference(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(expectedDifference));
+
+            AVLTree<int> a(first.begin(), first.end());
+            AVLTree<int> b(second.begin(), second.end());
+            a.union_with(b);
+            assert(b.size() == second.size()); // const& - other не меняется
+            assert(a.checkHeights() && a.checkParents() && a.size() == expectedUnion.size());
+            assert(std::equal(a.begin(), a.end(), expectedUnion.begin(), expectedUnion.end()));
+
+            AVLTree<int> c(first.begin(), first.end());
+            c.intersect_with(std::move(b));
+            assert(b.isEmpty() && c.checkHeights() && c.checkParents());
+            assert(std::equal(c.begin(), c.end(), expectedIntersection.begin(), expectedIntersection.end()));
+
+            AVLTree<int> d(first.begin(), first.end());
+            AVLTree<int> e(second.begin(), second.end());
+            d.difference_with(std::move(e));
+            assert(d.checkHeights() && d.checkParents() && d.size() == expectedDifference.size());
+            assert(std::equal(d.begin(), d.end(), expectedDifference.begin(), expectedDifference.end()));
+        }
+
+        // Объединение перевешивает узлы other; при разных пулах значения переносятся в узлы своего пула
+        AVLTree<int> target;
+        AVLTree<int> donor;
+        target.insert(1);
+        donor.insert(2);
+        AVLTreeNode<int>* donorNode = donor.findNode(2);
+        target.union_with(std::move(donor));
+        assert(target.findNode(2) == donorNode && donor.isEmpty());
+        AVLTree<int, NodePoolAllocator<int>> pooled;
+        AVLTree<int, NodePoolAllocator<int>> otherPool;
+        for (int k = 0; k < 100; k++) {
+            pooled.insert(k * 2);
+            otherPool.insert(k * 3);
+        }
+        pooled.union_with(std::move(otherPool));
+        assert(otherPool.isEmpty() && pooled.size() == 166 && pooled.checkHeights() && pooled.checkParents());
+
+        // Параллельное построение и операции над множествами дают те же деревья, что и последовательные
+        WorkStealingPool pool(4);
+        std::vector<int> parallelKeys;
+        for (int k = 0; k < 100000; k++) {
+            parallelKeys.push_back(k * 3);
+            if (k % 1000 == 0) {
+                parallelKeys.push_back(k * 3); // повтор
+            }
+        }
+        AVLTree<int> parallelBuilt;
+        parallelBuilt.assignSorted(parallelKeys.begin(), parallelKeys.end(), pool);
+        assert(parallelBuilt.size() == 100000 && parallelBuilt.checkHeights() && parallelBuilt.checkParents());
+        assert(parallelBuilt.select(12345) == 12345 * 3);
+        std::vector<int> secondKeys;
+        for (int k = 0; k < 60000; k++) {
+            secondKeys.push_back(k * 5);
+        }
+        std::vector<int> expectedKeys;
+        std::set_union(parallelKeys.begin(), parallelKeys.end(), secondKeys.begin(), secondKeys.end(), std::back_inserter(expectedKeys));
+        expectedKeys.erase(std::unique(expectedKeys.begin(), expectedKeys.end()), expectedKeys.end());
+        AVLTree<int> secondTree;
+        secondTree.assignSorted(secondKeys.begin(), secondKeys.end(), pool);
+        parallelBuilt.union_with(std::move(secondTree), pool);
+        assert(parallelBuilt.checkHeights() && parallelBuilt.checkParents());
+        assert(std::equal(parallelBuilt.begin(), parallelBuilt.end(), expectedKeys.begin(), expectedKeys.end()));
+        AVLTree<int> multiplesOf15;
+        for (int k = 0; k < 300000; k += 15) {
+            multiplesOf15.insert(k);
+        }
+        AVLTree<int> withoutFifteens(parallelBuilt.begin(), parallelBuilt.end());
+        parallelBuilt.intersect_with(AVLTree<int>(multiplesOf15.begin(), multiplesOf15.end()), pool);
+        assert(parallelBuilt.checkHeights() && parallelBuilt.checkParents() && parallelBuilt.size() == multiplesOf15.size());
+        withoutFifteens.difference_with(std::move(multiplesOf15), pool);
+        assert(withoutFifteens.checkHeights() && withoutFifteens.size() == expectedKeys.size() - parallelBuilt.size());
+        // Пустой результат: пересечение непересекающихся, разность с надмножеством, объединение пустых
+        std::vector<int> evens;
+        std::vector<int> odds;
+        for (int k = 0; k < 20000; k += 2) {
+            evens.push_back(k);
+            odds.push_back(k + 1);
+        }
+        AVLTree<int> disjoint(evens.begin(), evens.end());
+        disjoint.intersect_with(AVLTree<int>(odds.begin(), odds.end()), pool);
+        assert(disjoint.isEmpty());
+        AVLTree<int> removedAll(evens.begin(), evens.end());
+        removedAll.difference_with(AVLTree<int>(evens.begin(), evens.end()), pool);
+        assert(removedAll.isEmpty());
+        AVLTree<int> emptyUnion;
+        emptyUnion.union_with(AVLTree<int>(), pool);
+        assert(emptyUnion.isEmpty());
+        removedAll.union_with(AVLTree<int>(odds.begin(), odds.end()), pool);
+        assert(removedAll.size() == odds.size() && removedAll.checkParents() && removedAll.root->n_parent == nullptr);
+
+        // Параллельный обход: каждый элемент ровно один раз; для Postorder дети раньше родителя
+        AVLTree<int> visited;
+        for (int k = 0; k < 20000; k++) {
+            visited.insert(k);
+        }
+        std::atomic<long long> visitedSum(0);
+        visited.parallel_for_each([&](int& val) { visitedSum += val; val += 1; }, 4, ApplyOrder::Inorder);
+        assert(visitedSum == 20000LL * 19999 / 2 && visited.select(0) == 1 && visited.select(19999) == 20000);
+        AVLTreeNode<int>* visitedRoot = visited.root;
+        std::atomic<bool> rootSeen(false);
+        std::atomic<bool> childAfterRoot(false);
+        visited.parallel_for_each([&](int& val) {
+            if (&val == &visitedRoot->n_data) {
+                rootSeen = true;
+            }
+            else if (rootSeen) {
+                childAfterRoot = true;
+            }
+        }, 4, ApplyOrder::Postorder);
+        assert(rootSeen && !childAfterRoot);
+        visitedSum = 0;
+        visited.parallel_for_each([&](int& val) { visitedSum += val; val -= 1; }, pool);
+        assert(visitedSum == 20000LL * 20001 / 2 && visited.select(0) == 0 && visited.select(19999) == 19999);
+        AVLTree<int>().parallel_for_each([](int&) { assert(false); }, pool);
+
+        // Шаблонный обход: по возрастанию и в обратном порядке (дети раньше родителя)
+        AVLTree<int> applied;
+        for (int k = 0; k < 100; k++) {
+            applied.insert(k);
+        }
+        std::vector<int> appliedOrder;
+        applied.apply([&](int& val) { appliedOrder.push_back(val); });
+        assert(std::equal(appliedOrder.begin(), appliedOrder.end(), applied.begin(), applied.end()));
+        appliedOrder.clear();
+        applied.apply([&](int& val) { appliedOrder.push_back(val); }, ApplyOrder::Postorder);
+        assert(appliedOrder.size() == 100 && appliedOrder.back() == applied.root->n_data);
+
+        // Потоковый вывод: числа через to_chars, строки как есть, дерево "лежа на боку"
+        AVLTree<int> printed;
+        for (int k : { 2, 1, 3, -40 }) {
+            printed.insert(k);
+        }
+        std::ostringstream flat;
+        printed.write_to(flat);
+        assert(flat.str() == "-40 1 2 3 ");
+        assert(printed.toString() == "-40 1 2 3 ");
+        std::ostringstream layout;
+        printed.write_tree_to(layout);
+        assert(layout.str() == "  3\n2\n  1\n    -40\n");
+        AVLTree<double> fractions;
+        fractions.insert(0.5);
+        fractions.insert(-2.25);
+        std::ostringstream doubles;
+        fractions.write_to(doubles);
+        assert(doubles.str() == "-2.25 0.5 ");
+        AVLTree<std::string> words;
+        words.insert("pear");
+        words.insert("apple");
+        std::ostringstream text;
+        words.write_to(text);
+        assert(text.str() == "apple pear ");
+        // Вывод больше буфера (OutputBuffer::CAPACITY)
+        std::vector<int> many(20000);
+        std::string expectedText;
+        for (int k = 0; k < 20000; k++) {
+            many[k] = k;
+            expectedText += std::to_string(k) + " ";
+        }
+        AVLTree<int> manyTree;
+        manyTree.assignSorted(many.begin(), many.end());
+        std::ostringstream large;
+        manyTree.write_to(large);
+        assert(expectedText.size() > OutputBuffer::CAPACITY);
+        assert(large.str() == expectedText);
+
+        // Счетчики операций (TreeStats.h)
+        AVLTree<int> counted;
+        for (int k = 1; k <= 3; k++) {
+            counted.insert(k); // Вставка 3 - одинарный левый поворот
+        }
+        TreeStats insertStats = counted.stats();
+#ifdef AVLTREE_STATS
+        assert(insertStats.allocations == 3 && insertStats.frees == 0);
+        assert(insertStats.singleRotations == 1 && insertStats.doubleRotations == 0);
+        assert(insertStats.searches == 3 && insertStats.searchPathTotal == 3 && insertStats.searchPathMax == 2);
+        assert(insertStats.comparisons == 3 && insertStats.averageSearchPath() == 1.0);
+        counted.clear();
+        assert(counted.stats().frees == 3);
+        counted.resetStats();
+        for (int k : { 3, 1, 2 }) {
+            counted.insert(k); // Вставка 2 - большой правый поворот
+        }
+        assert(counted.stats().singleRotations == 0 && counted.stats().doubleRotations == 1);
+        counted.remove(2);
+        assert(counted.stats().frees == 1 && counted.stats().searches == 4);
+        assert(counted.find(1) != nullptr && counted.stats().searches == 5);
+
+        // Шаги итератора по идеальному дереву 1..7: переходы 1+1+2+2+1+1+3
+        std::vector<int> seven = { 1, 2, 3, 4, 5, 6, 7 };
+        counted.assignSorted(seven.begin(), seven.end());
+        counted.resetStats();
+        assert(std::equal(counted.begin(), counted.end(), seven.begin(), seven.end()));
+        TreeStats walkStats = counted.stats();
+        assert(walkStats.iteratorSteps == 7 && walkStats.iteratorHops == 11 && walkStats.iteratorHopsMax == 3);
+        assert(walkStats.comparisons == 0 && walkStats.allocations == 0);
+
+        // Сравнения прибавляются один раз за операцию: ранг 1 - путь 4, 2, 1; пакет { 4, 7 } - 1 + 3
+        assert(counted.rank(1) == 0 && counted.stats().comparisons == 3 && counted.stats().searches == 0);
+        const int pair[] = { 4, 7 };
+        AVLTreeNode<int>* pairOut[2];
+        counted.find_batch(pair, pairOut);
+        assert(pairOut[0]->n_data == 4 && pairOut[1]->n_data == 7 && counted.stats().comparisons == 7);
+#else
+        // Без AVLTREE_STATS счетчиков нет: нули и прежний размер итератора
+        assert(insertStats.comparisons == 0 && insertStats.allocations == 0 && insertStats.searches == 0);
+        static_assert(sizeof(Iterator) == 2 * sizeof(AVLTreeNode<T>*), "итератор без счетчиков - два указателя");
+        counted.resetStats();
+#endif
+
         std::cout << "All tests passed successfully!" << std::endl;
     }
 
@@ -540,41 +2562,39 @@ AVLTreeNode<T>* findHelper(AVLTreeNode<T>* node, const T& data) {
     }
 }
 
-// Функция для уничтожения дерева.
+// Вспомогательный метод проверки высот: возвращает настоящую высоту поддерева или -1,
+// если хранимая высота, коэффициент баланса или AVL-свойство нарушены.
 template<typename T>
-void clearNode(AVLTreeNode<T>* node) {
+int checkHeightsHelper(const AVLTreeNode<T>* node) {
     if (node == nullptr) {
-        return;
+        return 0;
     }
 
-    clearNode(node->getLeft());
-    clearNode(node->getRight());
-    delete node;
-}
-
-// Вспомогательный метод для вывода дерева в виде дерева.
-template<typename T>
-void printTreeHelper(AVLTreeNode<T>* node, int level) {
-    if (node == nullptr) {
-        return;
+    int leftHeight = checkHeightsHelper(node->getLeft());
+    int rightHeight = checkHeightsHelper(node->getRight());
+    if (leftHeight < 0 || rightHeight < 0) {
+        return -1;
     }
-
-    printTreeHelper(node->getRight(), level + 1);
-    for (int i = 0; i < level; i++) {
-        std::cout << "  ";
+    int height = 1 + std::max(leftHeight, rightHeight);
+    size_t size = 1 + (node->getLeft() ? node->getLeft()->subtreeSize : 0) + (node->getRight() ? node->getRight()->subtreeSize : 0);
+    if (node->subtreeSize != size || node->height != height || node->balanceFactor != leftHeight - rightHeight || std::abs(leftHeight - rightHeight) > 1) {
+        return -1;
     }
-    std::cout << node->n_data << std::endl;
-    printTreeHelper(node->getLeft(), level + 1);
+    return height;
 }
 
-// Вспомогательный метод для вывода дерева в виде строки.
+// Вспомогательный метод проверки родительских указателей поддерева.
 template<typename T>
-void toStringHelper(AVLTreeNode<T>* node, std::string& result) {
+bool checkParentsHelper(const AVLTreeNode<T>* node) {
     if (node == nullptr) {
-        return;
+        return true;
     }
 
-    toStringHelper(node->getLeft(), result);
-    result += std::to_string(node->n_data) + " ";
-    toStringHelper(node->getRight(), result);
-}
\ No newline at end of file
+    if (node->getLeft() != nullptr && node->getLeft()->n_parent != node) {
+        return false;
+    }
+    if (node->getRight() != nullptr && node->getRight()->n_parent != node) {
+        return false;
+    }
+    return checkParentsHelper(node->getLeft()) && checkParentsHelper(node->getRight());
+}
@@ -15,6 +15,18 @@
 #include <vector>
 #include <stack>
 #include <stdexcept>
+#include <iterator>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+#include "NodeAllocator.h"
+#include "TreeWriter.h"
+#include "TreeStats.h"
+#include "WorkStealingPool.h"
 
 //копи рекусрсив в приват
 //все тесты на все рекурс функции и на методы очисткиGOOD,, поиска, копирования, сосаниеGOOD
@@ -35,14 +47,21 @@ public:
     // Указатель на следующий узел в списке.
     TreeNode<T>* n_right;
 
+    // Указатель на родителя (nullptr у корня). Позволяет итераторам ходить по дереву без стека.
+    TreeNode<T>* n_parent;
+
     // Конструктор по умолчанию.
-    TreeNode() : n_data(T()), n_left(nullptr), n_right(nullptr) {}
+    TreeNode() : n_data(T()), n_left(nullptr), n_right(nullptr), n_parent(nullptr) {}
 
     // Конструктор, принимающий данные.
-    TreeNode(const T& data) : n_data(data), n_left(nullptr), n_right(nullptr) {}
+    TreeNode(const T& data) : n_data(data), n_left(nullptr), n_right(nullptr), n_parent(nullptr) {}
+
+    // Конструктор, создающий данные на месте из аргументов args.
+    template<typename... Args>
+    TreeNode(std::in_place_t, Args&&... args) : n_data(std::forward<Args>(args)...), n_left(nullptr), n_right(nullptr), n_parent(nullptr) {}
 
     // Конструктор, принимающий данные и указатели на предыдущий и следующий узлы.
-    TreeNode(const T& data, TreeNode<T>* prev, TreeNode<T>* next) : n_data(data), n_left(prev), n_right(next) {}
+    TreeNode(const T& data, TreeNode<T>* prev, TreeNode<T>* next) : n_data(data), n_left(prev), n_right(next), n_parent(nullptr) {}
     //Деструктор:
     ~TreeNode() {
         // Удаляем указатели на предыдущий и следующий узлы
@@ -53,23 +72,26 @@ public:
     }
     //Конструктор копирования :
 
-    TreeNode(const TreeNode& other) : n_data(other.n_data), n_left(nullptr), n_right(nullptr) {
+    TreeNode(const TreeNode& other) : n_data(other.n_data), n_left(nullptr), n_right(nullptr), n_parent(nullptr) {
         // Копируем указатели на предыдущий и следующий узлы
         if (other.n_left != nullptr) {
             n_left = new TreeNode(other.n_left->n_data);
+            n_left->n_parent = this;
         }
         if (other.n_right != nullptr) {
             n_right = new TreeNode(other.n_right->n_data);
+            n_right->n_parent = this;
         }
     }
 
 
     //Конструктор перемещения :
 
-    TreeNode(TreeNode&& other) : n_data(other.n_data), n_left(other.n_left), n_right(other.n_right) {
+    TreeNode(TreeNode&& other) : n_data(other.n_data), n_left(other.n_left), n_right(other.n_right), n_parent(other.n_parent) {
         // Перемещаем указатели на предыдущий и следующий узлы
         other.n_left = nullptr;
         other.n_right = nullptr;
+        other.n_parent = nullptr;
     }
 
 
@@ -89,9 +111,11 @@ public:
         n_data = other.n_data;
         if (other.n_left != nullptr) {
             n_left = new TreeNode(other.n_left->n_data);
+            n_left->n_parent = this;
         }
         if (other.n_right != nullptr) {
             n_right = new TreeNode(other.n_right->n_data);
+            n_right->n_parent = this;
         }
 
         return *this;
@@ -110,10 +134,12 @@ public:
         n_data = other.n_data;
         n_left = other.n_left;
         n_right = other.n_right;
+        n_parent = other.n_parent;
 
         // Очищаем указатели в перемещаемом узле
         other.n_left = nullptr;
         other.n_right = nullptr;
+        other.n_parent = nullptr;
 
         return *this;
     }
@@ -126,42 +152,55 @@ size_t countNodesRecursive(const TreeNode<T>* node) {
     //Возвращаем количество узлов слева и справа + сам узел
     return 1 + countNodesRecursive(node->n_left) + countNodesRecursive(node->n_right);
 }
-// Добавить значение к узлу в виде нового узла. N | N | N
+// Подвесить готовый узел newNode в поддерево node по значению (равные уходят вправо). Log2N | N | 1
 template<typename T>
-static void addNodeBST(TreeNode<T>* node, T value) {
-    if (value < node->n_data) {
-        if (node->n_left) {
-            addNodeBST(node->n_left, value);
-        }
-        else
-        {
-            node->n_left = new TreeNode<T>(value);
-        }
-    }
-    else
-    {
-        if (node->n_right) {
-            addNodeBST(node->n_right, value);
-        }
-        else
-        {
-            node->n_right = new TreeNode<T>(value);
+void attachNodeBST(TreeNode<T>* node, TreeNode<T>* newNode) {
+    while (true) {
+        TreeNode<T>*& next = newNode->n_data < node->n_data ? node->n_left : node->n_right;
+        if (next == nullptr) {
+            next = newNode;
+            newNode->n_parent = node;
+            return;
         }
+        node = next;
     }
 }
-// Рекурсивная функция копирования из бинарного поиска дерева одного (node) в корень бинарного поиска дерева другого (root)
-// Указатель на указатель передавать в качестве аргумента. N | N | N
+// Добавить значение к узлу в виде нового узла, узел создается распределителем alloc.
+// Значение копируется один раз - в новый узел. Log2N | N | 1
+template<typename T, typename NodeAlloc>
+static void addNodeBST(TreeNode<T>* node, const T& value, NodeAlloc& alloc) {
+    attachNodeBST(node, allocateNode(alloc, value));
+}
+// Добавить значение к узлу в виде нового узла. N | N | N
 template<typename T>
-TreeNode<T>* copyRecursive(TreeNode<T>* root) {
+static void addNodeBST(TreeNode<T>* node, const T& value) {
+    std::allocator<TreeNode<T>> alloc;
+    addNodeBST(node, value, alloc);
+}
+// Рекурсивная функция копирования из бинарного поиска дерева одного (node) в корень бинарного поиска дерева другого (root)
+// Новые узлы создаются распределителем alloc. N | N | N
+template<typename T, typename NodeAlloc>
+TreeNode<T>* copyRecursive(TreeNode<T>* root, NodeAlloc& alloc) {
     if (root == nullptr)
         return nullptr;
-    TreeNode<T>* newNode = new TreeNode<T>(root->n_data);
-    newNode->n_left = copyRecursive(root->n_left);
-    newNode->n_right = copyRecursive(root->n_right);
+    TreeNode<T>* newNode = allocateNode(alloc, root->n_data);
+    newNode->n_left = copyRecursive(root->n_left, alloc);
+    newNode->n_right = copyRecursive(root->n_right, alloc);
+    if (newNode->n_left)
+        newNode->n_left->n_parent = newNode;
+    if (newNode->n_right)
+        newNode->n_right->n_parent = newNode;
 
     return newNode;
 
 }
+// Рекурсивная функция копирования из бинарного поиска дерева одного (node) в корень бинарного поиска дерева другого (root)
+// Указатель на указатель передавать в качестве аргумента. N | N | N
+template<typename T>
+TreeNode<T>* copyRecursive(TreeNode<T>* root) {
+    std::allocator<TreeNode<T>> alloc;
+    return copyRecursive(root, alloc);
+}
 template<typename T>
 // Рекурсивная функция определения глубины (инордерный обход). Пустое дерево имеет глубину -1. N | N | N
 int getDepthRecursive(const TreeNode<T>* node) {
@@ -171,31 +210,20 @@ int getDepthRecursive(const TreeNode<T>* node) {
     return 1 + max(leftDepth, rightDepth);
 }
 
-template<typename T>
-// Рекурсивный вывод дерева. N | N | N
-void printTreeRecursive(const TreeNode<T>* node, int level) {
-    if (node == nullptr) return;
-
-    // Печать правого поддерева
-    printTreeRecursive(node->n_right, level + 1);
-
-    // Печать текущего узла. Число пропусков определяется уровнем
-    for (int i = 0; i < level; i++) {
-        cout << "    ";
+// Удалеяет дерево, узлы возвращаются распределителю alloc. N | N | N
+template<typename T, typename NodeAlloc>
+void deleteTree(TreeNode<T>* node, NodeAlloc& alloc) {
+    if (node) {
+        deleteTree(node->n_left, alloc);
+        deleteTree(node->n_right, alloc);
+        freeNode(alloc, node);
     }
-    cout << node->n_data << endl;
-
-    // Печать левого поддерева
-    printTreeRecursive(node->n_left, level + 1);
 }
 // Удалеяет дерево. N | N | N
 template<typename T>
 void deleteTree(TreeNode<T>* node) {
-    if (node) {
-        deleteTree(node->n_left);
-        deleteTree(node->n_right);
-        delete node;
-    }
+    std::allocator<TreeNode<T>> alloc;
+    deleteTree(node, alloc);
 }
 
 
@@ -216,6 +244,72 @@ TreeNode<T>* searchRecursive(TreeNode<T>* node, const T& value) {
         return searchRecursive(node->n_right, value); // Ищем в правом поддереве
     }
 }
+// Проставляет родительские указатели во всем поддереве node (для деревьев, собранных вручную). N | N | N
+template<typename T>
+void linkParents(TreeNode<T>* node) {
+    if (node == nullptr) return;
+    if (node->n_left) {
+        node->n_left->n_parent = node;
+        linkParents(node->n_left);
+    }
+    if (node->n_right) {
+        node->n_right->n_parent = node;
+        linkParents(node->n_right);
+    }
+}
+// Самый левый (наименьший) узел поддерева. Каждый переход отмечается вызовом hop (см. TreeStats.h). Log2N | N | 1
+template<typename T, typename Hop = IgnoreHops>
+TreeNode<T>* leftmostNode(TreeNode<T>* node, Hop hop = Hop()) {
+    if (node == nullptr) return nullptr;
+    while (node->n_left != nullptr) {
+        node = node->n_left;
+        hop();
+    }
+    return node;
+}
+// Самый правый (наибольший) узел поддерева. Log2N | N | 1
+template<typename T, typename Hop = IgnoreHops>
+TreeNode<T>* rightmostNode(TreeNode<T>* node, Hop hop = Hop()) {
+    if (node == nullptr) return nullptr;
+    while (node->n_right != nullptr) {
+        node = node->n_right;
+        hop();
+    }
+    return node;
+}
+// Следующий узел в порядке LNR по родительским указателям, nullptr после последнего.
+// Амортизированно 1 при полном обходе. 1 | Log2N (N для вырожденного дерева) | 1
+template<typename T, typename Hop = IgnoreHops>
+TreeNode<T>* inorderNext(TreeNode<T>* node, Hop hop = Hop()) {
+    if (node->n_right != nullptr) {
+        hop();
+        return leftmostNode(node->n_right, hop);
+    }
+    TreeNode<T>* parent = node->n_parent;
+    hop();
+    while (parent != nullptr && node == parent->n_right) {
+        node = parent;
+        parent = parent->n_parent;
+        hop();
+    }
+    return parent;
+}
+// Предыдущий узел в порядке LNR по родительским указателям, nullptr перед первым. 1 | Log2N | 1
+template<typename T, typename Hop = IgnoreHops>
+TreeNode<T>* inorderPrev(TreeNode<T>* node, Hop hop = Hop()) {
+    if (node->n_left != nullptr) {
+        hop();
+        return rightmostNode(node->n_left, hop);
+    }
+    TreeNode<T>* parent = node->n_parent;
+    hop();
+    while (parent != nullptr && node == parent->n_left) {
+        node = parent;
+        parent = parent->n_parent;
+        hop();
+    }
+    return parent;
+}
 template<typename T>
 // Препорядковый обход (Near, Left, Right)
 void preorder(TreeNode<T>* node, vector<T>& result) {
@@ -248,6 +342,89 @@ void postorder(TreeNode<T>* node, vector<T>& result) {
     postorder(node->n_right, result);
     result.push_back(node->n_data);
 }
+// Порядок обхода при применении функции. При параллельном обходе общего порядка между потоками нет, но для
+// Preorder родитель обрабатывается раньше детей, а для Postorder - позже; Inorder - порядок внутри поддеревьев.
+enum class ApplyOrder { Preorder, Inorder, Postorder };
+
+template<ApplyOrder order, typename T, typename F>
+// Итеративный обход поддерева top с посетителем-шаблоном: вызов func встраивается (нет косвенного вызова
+// std::function на каждый узел), а вместо стека используются ссылки на родителей, поэтому глубина
+// вырожденного древа не ограничена. func не должна менять структуру древа. N | N | 1
+void visitSubtree(TreeNode<T>* top, F& func) {
+    if (top == nullptr) {
+        return;
+    }
+    TreeNode<T>* stop = top->n_parent;
+    TreeNode<T>* previous = stop;
+    TreeNode<T>* node = top;
+    while (node != stop) {
+        TreeNode<T>* next;
+        if (previous == node->n_parent) {
+            // Пришли сверху
+            if constexpr (order == ApplyOrder::Preorder) {
+                func(node->n_data);
+            }
+            if (node->n_left != nullptr) {
+                next = node->n_left;
+            }
+            else {
+                if constexpr (order == ApplyOrder::Inorder) {
+                    func(node->n_data);
+                }
+                if (node->n_right != nullptr) {
+                    next = node->n_right;
+                }
+                else {
+                    if constexpr (order == ApplyOrder::Postorder) {
+                        func(node->n_data);
+                    }
+                    next = node == top ? stop : node->n_parent;
+                }
+            }
+        }
+        else if (previous == node->n_left) {
+            // Вернулись из левого поддерева
+            if constexpr (order == ApplyOrder::Inorder) {
+                func(node->n_data);
+            }
+            if (node->n_right != nullptr) {
+                next = node->n_right;
+            }
+            else {
+                if constexpr (order == ApplyOrder::Postorder) {
+                    func(node->n_data);
+                }
+                next = node == top ? stop : node->n_parent;
+            }
+        }
+        else {
+            // Вернулись из правого поддерева
+            if constexpr (order == ApplyOrder::Postorder) {
+                func(node->n_data);
+            }
+            next = node == top ? stop : node->n_parent;
+        }
+        previous = node;
+        node = next;
+    }
+}
+
+template<typename T, typename F>
+// Итеративное применение func к поддереву в порядке order. N | N | 1
+void applyOrdered(TreeNode<T>* node, F& func, ApplyOrder order) {
+    switch (order) {
+    case ApplyOrder::Preorder:
+        visitSubtree<ApplyOrder::Preorder>(node, func);
+        break;
+    case ApplyOrder::Inorder:
+        visitSubtree<ApplyOrder::Inorder>(node, func);
+        break;
+    default:
+        visitSubtree<ApplyOrder::Postorder>(node, func);
+        break;
+    }
+}
+
 template<typename T>
 // Применение функции к каждому узлу NLR. N | N | N
 void applyFunction(TreeNode<T>* node, const function<void(T&)>& func) {
@@ -280,6 +457,88 @@ void applyPostorder(TreeNode<T>* node, const function<void(T&)>& func) {
     applyPostorder(node->n_right, func);
     func(node->n_data);
 }
+template<typename T, typename F>
+// Применение функции к узлам tops над независимыми поддеревьями параллельного обхода: до поддеревьев
+// в прямом порядке (beforeChunks, для Preorder) или после них от нижних к верхним (Inorder, Postorder). P | P | 1
+void applyTops(const vector<TreeNode<T>*>& tops, F& func, ApplyOrder order, bool beforeChunks) {
+    if ((order == ApplyOrder::Preorder) != beforeChunks) {
+        return;
+    }
+    if (beforeChunks) {
+        for (TreeNode<T>* node : tops) {
+            func(node->n_data);
+        }
+    }
+    else {
+        for (auto it = tops.rbegin(); it != tops.rend(); ++it) {
+            func((*it)->n_data);
+        }
+    }
+}
+template<typename T, typename F>
+// Параллельное применение функции: поддеревья chunks независимы и раздаются threads потокам по одному
+// (свободный поток берет следующее), узлы tops над ними (в прямом порядке) обрабатываются вызывающим
+// потоком до поддеревьев (Preorder) или после, от нижних к верхним (Inorder, Postorder).
+// Исключение из func останавливает раздачу и пробрасывается после завершения потоков. N | N/P | P
+void applyParallel(const vector<TreeNode<T>*>& tops, const vector<TreeNode<T>*>& chunks, F& func, ApplyOrder order, size_t threads) {
+    applyTops(tops, func, order, true);
+
+    std::atomic<size_t> next(0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto work = [&] {
+        size_t index;
+        while ((index = next.fetch_add(1)) < chunks.size()) {
+            try {
+                applyOrdered(chunks[index], func, order);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next.store(chunks.size());
+            }
+        }
+    };
+    vector<std::thread> helpers;
+    size_t helperCount = std::min(threads, chunks.size());
+    for (size_t i = 1; i < helperCount; i++) {
+        helpers.emplace_back(work);
+    }
+    work();
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    applyTops(tops, func, order, false);
+}
+template<typename T, typename F>
+// Обход поддеревьев chunks[first, last) потоками пула: диапазон делится пополам, правая половина
+// может быть украдена свободным потоком (см. WorkStealingPool::invoke). N | N/P | Log2(P)
+void applyChunks(const vector<TreeNode<T>*>& chunks, size_t first, size_t last, F& func, ApplyOrder order, WorkStealingPool& pool) {
+    if (last - first == 1) {
+        applyOrdered(chunks[first], func, order);
+        return;
+    }
+    size_t middle = first + (last - first) / 2;
+    pool.invoke([&] { applyChunks(chunks, first, middle, func, order, pool); },
+        [&] { applyChunks(chunks, middle, last, func, order, pool); });
+}
+template<typename T, typename F>
+// То же, что applyParallel, но поддеревья обходят потоки пула pool, а не потоки, создаваемые на каждый
+// вызов. Исключение из func пробрасывается после завершения остальных поддеревьев. N | N/P | P
+void applyParallel(const vector<TreeNode<T>*>& tops, const vector<TreeNode<T>*>& chunks, F& func, ApplyOrder order, WorkStealingPool& pool) {
+    applyTops(tops, func, order, true);
+    if (!chunks.empty()) {
+        pool.run([&] { applyChunks(chunks, 0, chunks.size(), func, order, pool); });
+    }
+    applyTops(tops, func, order, false);
+}
+
 template<typename T>
 // Поиск следующего наибольшего элемента, возвращает узел, иначе нуллптр. Log2N | N | 1
 TreeNode<T>* searchSucc(TreeNode<T>* current, const T& value) {
@@ -399,20 +658,21 @@ void postOrderTraversalIterative(TreeNode<T>* root) {
         }
     }
 }
-template<typename T>
-// Удаление узла рекурсивно. Не функция, так как тут используется. Передается адрес узла по ссылке 
-void deleteNodeRecursive(TreeNode<T>** node, const T& value) {
+template<typename T, typename NodeAlloc>
+// Удаление узла рекурсивно. Не функция, так как тут используется. Передается адрес узла по ссылке.
+// Узел возвращается распределителю alloc. Возвращает true, если узел был удален
+bool deleteNodeRecursive(TreeNode<T>** node, const T& value, NodeAlloc& alloc) {
     if (*node == nullptr) {
-        return; // Узел не найден
+        return false; // Узел не найден
     }
 
     // Если значение меньше, чем значение в текущем узле, идем влево
     if (value < (*node)->n_data) {
-        deleteNodeRecursive(&(*node)->n_left, value);
+        return deleteNodeRecursive(&(*node)->n_left, value, alloc);
     }
     // Если значение больше, чем значение в текущем узле, идем вправо
     else if (value > (*node)->n_data) {
-        deleteNodeRecursive(&(*node)->n_right, value);
+        return deleteNodeRecursive(&(*node)->n_right, value, alloc);
     }
     // Найден узел для удаления
     else {
@@ -421,48 +681,88 @@ void deleteNodeRecursive(TreeNode<T>** node, const T& value) {
         // Если у узла нет дочерних узлов, просто удаляем его
         if ((*node)->n_left == nullptr && (*node)->n_right == nullptr) {
             *node = nullptr;
-            delete nodeToDelete;
+            freeNode(alloc, nodeToDelete);
         }
         // Если у узла есть только левый дочерний узел, присоединяем его к родителю
         else if ((*node)->n_left != nullptr && (*node)->n_right == nullptr) {
             *node = (*node)->n_left;
+            (*node)->n_parent = nodeToDelete->n_parent;
             nodeToDelete->n_left = nullptr;
-            delete nodeToDelete;
+            freeNode(alloc, nodeToDelete);
         }
         // Если у узла есть только правый дочерний узел, присоединяем его к родителю
         else if ((*node)->n_left == nullptr && (*node)->n_right != nullptr) {
             *node = (*node)->n_right;
+            (*node)->n_parent = nodeToDelete->n_parent;
             nodeToDelete->n_right = nullptr;
-            delete nodeToDelete;
+            freeNode(alloc, nodeToDelete);
         }
-        // Если у узла есть оба дочерних узла, ищем следующий наибольший элемент и меняем местами
+        // Если у узла есть оба дочерних узла, на его место переставляется следующий наибольший узел
+        // (самый левый в правом поддереве). Данные не копируются, адреса остальных узлов не меняются
         else {
-            TreeNode<T>* nextLargest = searchSucc(*node, (*node)->n_data);
-            (*node)->n_data = nextLargest->n_data;
-            deleteNodeRecursive(&(*node)->n_right, nextLargest->n_data);
+            TreeNode<T>* nextLargest = leftmostNode(nodeToDelete->n_right);
+            if (nextLargest != nodeToDelete->n_right) {
+                nextLargest->n_parent->n_left = nextLargest->n_right;
+                if (nextLargest->n_right)
+                    nextLargest->n_right->n_parent = nextLargest->n_parent;
+                nextLargest->n_right = nodeToDelete->n_right;
+                nextLargest->n_right->n_parent = nextLargest;
+            }
+            nextLargest->n_left = nodeToDelete->n_left;
+            nextLargest->n_left->n_parent = nextLargest;
+            nextLargest->n_parent = nodeToDelete->n_parent;
+            *node = nextLargest;
+            nodeToDelete->n_left = nullptr;
+            nodeToDelete->n_right = nullptr;
+            freeNode(alloc, nodeToDelete);
         }
+        return true;
     }
 }
+template<typename T>
+// Удаление узла рекурсивно. Передается адрес узла по ссылке. Возвращает true, если узел был удален
+bool deleteNodeRecursive(TreeNode<T>** node, const T& value) {
+    std::allocator<TreeNode<T>> alloc;
+    return deleteNodeRecursive(node, value, alloc);
+}
 
 
-template<typename T>
+// Бинарное дерево поиска. Alloc - распределитель памяти для узлов (см. NodeAllocator.h)
+template<typename T, typename Alloc = std::allocator<T>>
 class BinarySearchTree {
 private:
+    // Распределитель, перепривязанный к типу узла
+    using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<TreeNode<T>>;
+
     TreeNode<T>* root;
+    NodeAlloc nodeAlloc;
+    // Число узлов дерева, поддерживается вставкой и удалением
+    size_t nodeCount;
+#ifdef AVLTREE_STATS
+    // Счетчики операций (см. TreeStats.h)
+    mutable TreeCounters counters;
+#endif
 
 public:
 
-    BinarySearchTree() :root(nullptr) {}
-    BinarySearchTree(T value) {
-        root = new TreeNode<T>(value);
+    BinarySearchTree(const Alloc& alloc = Alloc()) :root(nullptr), nodeAlloc(alloc), nodeCount(0) {}
+    BinarySearchTree(T value, const Alloc& alloc = Alloc()) : nodeAlloc(alloc), nodeCount(1) {
+        root = allocateNode(nodeAlloc, value);
+        AVLTREE_STAT(counters.countAllocations(1));
     }
-    BinarySearchTree(TreeNode<T>* n_root) {
+    // Дерево становится владельцем узлов n_root, они должны быть созданы тем же распределителем
+    BinarySearchTree(TreeNode<T>* n_root, const Alloc& alloc = Alloc()) : nodeAlloc(alloc) {
         root = n_root;
+        if (root) {
+            root->n_parent = nullptr;
+            linkParents(root);
+        }
+        nodeCount = countNodesRecursive(root);
     }
 
 
     ~BinarySearchTree() {
-        deleteTree(root);
+        clear();
     }
     /*
     enum OrderType {
@@ -471,96 +771,249 @@ public:
         POSTORDER // LRN
     };
     */
+    // Двунаправленный итератор LNR. Хранит текущий узел и корень (для шага назад от конца),
+    // ходит по родительским указателям, поэтому ничего не выделяет и копируется как пара указателей.
     class Iterator {
     private:
-        std::stack<TreeNode<T>*> nodeStack;
+        friend class BinarySearchTree;
+
+        TreeNode<T>* root;
+        TreeNode<T>* node;
+#ifdef AVLTREE_STATS
+        // Счетчики дерева, учитывающие шаги (nullptr - не учитывать)
+        TreeCounters* counters = nullptr;
+#endif
 
     public:
-        Iterator(TreeNode<T>* root) {
-            pushLeftBranch(root);
-        }
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        Iterator() : root(nullptr), node(nullptr) {}
+
+        // Итератор на первом элементе дерева root
+        Iterator(TreeNode<T>* n_root) : root(n_root), node(leftmostNode(n_root)) {}
+
+        // Итератор на узле n_node дерева n_root (nullptr - конец)
+        Iterator(TreeNode<T>* n_root, TreeNode<T>* n_node) : root(n_root), node(n_node) {}
 
         bool operator!=(const Iterator& other) const {
-            return !(hasNext() == false && other.hasNext() == false);
+            return node != other.node;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return node == other.node;
         }
 
         bool hasNext() const {
 
-            return !nodeStack.empty();
+            return node != nullptr;
         }
 
         T& operator*() const {
-            return nodeStack.top()->n_data;
+            return node->n_data;
         }
 
+        T* operator->() const {
+            return &node->n_data;
+        }
 
         T& data() {
-            return nodeStack.top()->n_data;
+            return node->n_data;
         }
 
         Iterator& operator++() {
             return next();
         }
 
+        Iterator operator++(int) {
+            Iterator old = *this;
+            next();
+            return old;
+        }
+
+        Iterator& operator--() {
+            return prev();
+        }
+
+        Iterator operator--(int) {
+            Iterator old = *this;
+            prev();
+            return old;
+        }
+
         void reset() {
-            while (!nodeStack.empty())
-                nodeStack.pop();
-            inorderStack(root, nodeStack);
+            node = leftmostNode(root);
         }
 
         Iterator& next() {
-            TreeNode<T>* currentNode;
             if (!hasNext()) {
                 throw std::out_of_range("No more elements in the iterator");
             }
-            currentNode = nodeStack.top();
-            nodeStack.pop();
-            pushLeftBranch(currentNode->n_right);
+#ifdef AVLTREE_STATS
+            uint64_t hops = 0;
+            node = inorderNext(node, CountHops{ hops });
+            if (counters != nullptr) {
+                counters->recordStep(hops);
+            }
+#else
+            node = inorderNext(node);
+#endif
             return *this;
         }
 
-    private:
-        void pushLeftBranch(TreeNode<T>* node) {
-            while (node != nullptr) {
-                nodeStack.push(node);
-                node = node->n_left;
+        // Шаг назад; от конца переходит к последнему элементу
+        Iterator& prev() {
+#ifdef AVLTREE_STATS
+            uint64_t hops = 0;
+            TreeNode<T>* previous = node == nullptr ? rightmostNode(root, CountHops{ hops }) : inorderPrev(node, CountHops{ hops });
+#else
+            TreeNode<T>* previous = node == nullptr ? rightmostNode(root) : inorderPrev(node);
+#endif
+            if (previous == nullptr) {
+                throw std::out_of_range("No previous elements in the iterator");
             }
+            node = previous;
+            AVLTREE_STAT(if (counters != nullptr) { counters->recordStep(hops); });
+            return *this;
         }
     };
 
+    using ReverseIterator = std::reverse_iterator<Iterator>;
 
     Iterator begin() const {
-        return Iterator(root);
+        Iterator result(root);
+        AVLTREE_STAT(result.counters = &counters);
+        return result;
     }
 
     Iterator end() const {
-        return Iterator(nullptr);
+        Iterator result(root, nullptr);
+        AVLTREE_STAT(result.counters = &counters);
+        return result;
+    }
+
+    // Обход в обратном порядке (RNL)
+    ReverseIterator rbegin() const {
+        return ReverseIterator(end());
+    }
+
+    ReverseIterator rend() const {
+        return ReverseIterator(begin());
     }
     // Копировать древо из other
     void copy(BinarySearchTree& other)
     {
         clear();
-        root = copyRecursive(other.get_root());
+        root = copyRecursive(other.get_root(), nodeAlloc);
+        nodeCount = other.nodeCount;
+        AVLTREE_STAT(counters.countAllocations(nodeCount));
     }
 
-    // Очистка древа
+    // Очистка древа. Для арены (ArenaAllocator) и тривиально разрушаемых T - 1 | 1 | 1, иначе N | N | N
     void clear() {
-        deleteTree(root);   // Очищаем дерево
+        AVLTREE_STAT(counters.countFrees(nodeCount));
+        if (!(std::is_trivially_destructible<T>::value && releaseAllNodes(nodeAlloc))) {
+            deleteTree(root, nodeAlloc);   // Очищаем дерево
+        }
         root = nullptr; // Обнуляем корень дерева
+        nodeCount = 0;
     }
     // Применить функцию к элементам древа
     void apply(const function<void(T&)>& func) {
         applyFunction(root, func);
     }
+    // Применить функцию-шаблон к элементам древа в порядке order: вызов встраивается, обход итеративный
+    // и не зависит от глубины древа. Объект std::function без order по-прежнему идет в apply выше. N | N | 1
+    template<typename F> requires (!std::is_same_v<std::remove_cvref_t<F>, function<void(T&)>>)
+    void apply(F&& func) {
+        applyOrdered(root, func, ApplyOrder::Preorder);
+    }
+    template<typename F>
+    void apply(F&& func, ApplyOrder order) {
+        applyOrdered(root, func, order);
+    }
+    // Применить функцию к элементам древа в threads потоках (func вызывается одновременно для разных
+    // элементов). Размеры поддеревьев не хранятся, поэтому древо режется на независимые поддеревья
+    // обходом в ширину от корня, пока их не станет CHUNKS_PER_THREAD на поток. N | N/P | N
+    template<typename F>
+    void parallel_apply(F&& func, size_t threads = std::thread::hardware_concurrency(), ApplyOrder order = ApplyOrder::Preorder) {
+        if (root == nullptr) {
+            return;
+        }
+        threads = std::max<size_t>(threads, 1);
+        vector<TreeNode<T>*> tops;
+        vector<TreeNode<T>*> chunks;
+        splitForParallel(threads, tops, chunks);
+        applyParallel(tops, chunks, func, order, threads);
+    }
+    // То же на потоках пула pool (см. WorkStealingPool.h): потоки не создаются на каждый вызов. N | N/P | N
+    template<typename F>
+    void parallel_apply(F&& func, WorkStealingPool& pool, ApplyOrder order = ApplyOrder::Preorder) {
+        if (root == nullptr) {
+            return;
+        }
+        vector<TreeNode<T>*> tops;
+        vector<TreeNode<T>*> chunks;
+        splitForParallel(pool.size(), tops, chunks);
+        applyParallel(tops, chunks, func, order, pool);
+    }
+    // Разрезание непустого древа для обхода в threads потоках: верхние узлы tops (обходом в ширину) и
+    // независимые поддеревья chunks под ними. Число верхних узлов ограничено 4 * threads * CHUNKS_PER_THREAD,
+    // чтобы вызывающий поток не обходил сам большую часть вырожденного древа. У списка на каждом уровне
+    // одно поддерево, поэтому после ограничения весь остаток списка - одно поддерево, и его обходит
+    // один поток: параллельный обход вырожденного древа не быстрее последовательного. N | N | N
+    void splitForParallel(size_t threads, vector<TreeNode<T>*>& tops, vector<TreeNode<T>*>& chunks) const {
+        vector<TreeNode<T>*> frontier = { root };
+        size_t wanted = threads <= 1 ? 1 : threads * CHUNKS_PER_THREAD;
+        size_t first = 0;
+        while (frontier.size() - first < wanted && first < frontier.size() && tops.size() < wanted * 4) {
+            TreeNode<T>* node = frontier[first++];
+            tops.push_back(node);
+            if (node->n_left != nullptr) {
+                frontier.push_back(node->n_left);
+            }
+            if (node->n_right != nullptr) {
+                frontier.push_back(node->n_right);
+            }
+        }
+        chunks.assign(frontier.begin() + first, frontier.end());
+    }
+    // Число независимых поддеревьев на поток при параллельном обходе: с запасом, чтобы потоки,
+    // получившие мелкие поддеревья, успели взять еще
+    static const size_t CHUNKS_PER_THREAD = 8;
     // Добавить значение дереву. Log2N | N | 1
     void insert(const T& value) {
+        emplace(value);
+    }
+    // Добавить значение перемещением. Log2N | N | 1
+    void insert(T&& value) {
+        emplace(std::move(value));
+    }
+    // Добавить значение, создаваемое на месте из args. Возвращает новый узел. Log2N | N | 1
+    template<typename... Args>
+    TreeNode<T>* emplace(Args&&... args) {
+        TreeNode<T>* node = allocateNode(nodeAlloc, std::in_place, std::forward<Args>(args)...);
         if (!root) {
-            root = new TreeNode<T>(value);
+            root = node;
         }
         else
         {
-            addNodeBST(root, value);
+            attachNodeBST(root, node);
         }
+        nodeCount++;
+#ifdef AVLTREE_STATS
+        // Спуск вставки сравнил значение с каждым предком нового узла
+        uint64_t depth = 0;
+        for (TreeNode<T>* parent = node->n_parent; parent != nullptr; parent = parent->n_parent) {
+            depth++;
+        }
+        counters.countAllocations(1);
+        counters.recordSearch(depth);
+#endif
+        return node;
     }
     // Вывести значение узла на экран
     void printNode(TreeNode<T>* node) const {
@@ -603,11 +1056,27 @@ public:
 
     // Вывод содержимого узлов дерева в порядке LNR. N | N | N
     void printInOrder() const {
-        vector<T> result = toArrayInOrder();
-        for (const T& val : result) {
-            cout << val << " ";
-        }
-        cout << endl;
+        OutputBuffer buffer(cout);
+        writeInOrder(buffer, static_cast<const TreeNode<T>*>(root));
+        buffer.put('\n');
+        buffer.flush();
+        cout.flush();
+    }
+
+    // Вывод элементов в порядке LNR через пробел в поток out; поток сбрасывается один раз в конце. N | N | N
+    void write_to(std::ostream& out) const {
+        OutputBuffer buffer(out);
+        writeInOrder(buffer, static_cast<const TreeNode<T>*>(root));
+        buffer.flush();
+        out.flush();
+    }
+
+    // Вывод дерева в виде дерева (как printTree) в поток out. N | N | N
+    void write_tree_to(std::ostream& out) const {
+        OutputBuffer buffer(out);
+        writeLayout(buffer, static_cast<const TreeNode<T>*>(root), 4);
+        buffer.flush();
+        out.flush();
     }
 
     // Вывод содержимого узлов дерева в порядке LRN. N | N | N
@@ -621,7 +1090,7 @@ public:
 
     // Функция печати дерева в виде дерева. N | N | N
     void printTree() const {
-        printTreeRecursive(root, 0);
+        write_tree_to(cout);
     }
     // Удаляет узел из дерева. Log2N | N | 1
     void remove(T value)
@@ -630,16 +1099,19 @@ public:
         {
             throw std::out_of_range("Дерево пустое");
         }
-        deleteNodeRecursive(&root, value);
+        if (deleteNodeRecursive(&root, value, nodeAlloc)) {
+            nodeCount--;
+            AVLTREE_STAT(counters.countFrees(1));
+        }
     }
 
     // Функция определения глубины дерева. N | N | N
     int getDepth() const {
         return getDepthRecursive(root);
     }
-    // Функция подсчета числа узлов. N | N | N
+    // Функция подсчета числа узлов (счетчик хранится в дереве). 1 | 1 | 1
     size_t countNodes() const {
-        return countNodesRecursive(root);
+        return nodeCount;
     }
     // Проверка на пустоту дерева
     bool isEmpty() const {
@@ -663,7 +1135,32 @@ public:
 
     // Метод для поиска узла по значению Log2N | N | 1
     TreeNode<T>* search(const T& value) const {
-        return searchRecursive(root, value); // Запускаем поиск с корневого узла
+        // Спуск от корня без рекурсии: на вырожденном дереве глубина рекурсии была бы N
+        AVLTREE_STAT(uint64_t length = 0);
+        TreeNode<T>* node = root;
+        while (node != nullptr) {
+            AVLTREE_STAT(length++);
+            if (node->n_data == value) {
+                break;
+            }
+            node = value < node->n_data ? node->n_left : node->n_right;
+        }
+        AVLTREE_STAT(counters.recordSearch(length));
+        return node;
+    }
+
+    // Снимок счетчиков операций; без AVLTREE_STATS - нули (см. TreeStats.h). 1 | 1 | 1
+    TreeStats stats() const {
+#ifdef AVLTREE_STATS
+        return counters.snapshot();
+#else
+        return TreeStats();
+#endif
+    }
+
+    // Обнуление счетчиков операций. 1 | 1 | 1
+    void resetStats() {
+        AVLTREE_STAT(counters.reset());
     }
 
     // Получить указатель на корень
@@ -697,7 +1194,7 @@ public:
         int i = 0;
         for (int value : bst) {
 
-            assert(value, inorderbst[i]);
+            assert(value == inorderbst[i]);
             i++;
         }
         //Проверка работы неравенства итераторов
@@ -924,6 +1421,157 @@ public:
         assert(singleNodeArray == expectedSingleNodeArray);
 
         singleNodeTree.clear();
+
+        // Параллельное применение функции: каждый элемент ровно один раз
+        BinarySearchTree<int> parallelTree;
+        for (int k = 0; k < 5000; k++) {
+            parallelTree.insert((k * 7919) % 5000);
+        }
+        parallelTree.parallel_apply([](int& val) { val = val * 2 + 1; }, 4);
+        vector<int> parallelValues = parallelTree.toArrayInOrder();
+        for (int k = 0; k < 5000; k++) {
+            assert(parallelValues[k] == k * 2 + 1);
+        }
+        parallelTree.parallel_apply([](int& val) { val = (val - 1) / 2; }, 3, ApplyOrder::Postorder);
+        assert(parallelTree.toArrayInOrder()[4999] == 4999);
+        degenerateTree.insert(1);
+        degenerateTree.insert(2);
+        degenerateTree.parallel_apply([](int& val) { val += 10; }, 4, ApplyOrder::Inorder);
+        assert(degenerateTree.toArrayInOrder() == vector<int>({ 11, 12 }));
+
+        // То же на пуле потоков; Inorder - верхние узлы после поддеревьев
+        WorkStealingPool applyPool(4);
+        parallelTree.parallel_apply([](int& val) { val = val * 2 + 1; }, applyPool);
+        parallelValues = parallelTree.toArrayInOrder();
+        for (int k = 0; k < 5000; k++) {
+            assert(parallelValues[k] == k * 2 + 1);
+        }
+        std::atomic<bool> topsAfterChunks(true);
+        std::atomic<int> pooledVisits(0);
+        TreeNode<int>* parallelRoot = parallelTree.root;
+        parallelTree.parallel_apply([&](int& val) {
+            if (&val == &parallelRoot->n_data && pooledVisits != 4999) {
+                topsAfterChunks = false;
+            }
+            pooledVisits++;
+        }, applyPool, ApplyOrder::Inorder);
+        assert(pooledVisits == 5000 && topsAfterChunks);
+        degenerateTree.parallel_apply([](int& val) { val -= 10; }, applyPool, ApplyOrder::Postorder);
+        assert(degenerateTree.toArrayInOrder() == vector<int>({ 1, 2 }));
+        degenerateTree.clear();
+
+        // Шаблонный итеративный обход: порядки совпадают с рекурсивными, стек не растет с глубиной древа
+        vector<int> visitedOrder;
+        arrayTree.apply([&](int& val) { visitedOrder.push_back(val); });
+        assert(visitedOrder == arrayTree.toArrayPreOrder());
+        visitedOrder.clear();
+        arrayTree.apply([&](int& val) { visitedOrder.push_back(val); }, ApplyOrder::Inorder);
+        assert(visitedOrder == arrayTree.toArrayInOrder());
+        visitedOrder.clear();
+        arrayTree.apply([&](int& val) { visitedOrder.push_back(val); }, ApplyOrder::Postorder);
+        assert(visitedOrder == arrayTree.toArrayPostOrder());
+        std::allocator<TreeNode<int>> chainAlloc;
+        TreeNode<int>* chain = nullptr;
+        for (int k = 19999; k >= 0; k--) {
+            TreeNode<int>* node = allocateNode(chainAlloc, k);
+            node->n_right = chain; // значения по возрастанию: древо - правый список
+            chain = node;
+        }
+        BinarySearchTree<int> deepTree(chain);
+        long long deepSum = 0;
+        deepTree.apply([&](int& val) { deepSum += val; }, ApplyOrder::Postorder);
+        assert(deepSum == 20000LL * 19999 / 2);
+
+        // Тест распределителей узлов
+        BinarySearchTree<int, NodePoolAllocator<int>> poolTree;
+        BinarySearchTree<int, ArenaAllocator<int>> arenaTree;
+        for (int value : { 10, 5, 15, 2, 7, 12, 20 }) {
+            poolTree.insert(value);
+            arenaTree.insert(value);
+        }
+        poolTree.remove(10);
+        arenaTree.remove(10);
+        assert(poolTree.toArrayInOrder() == arenaTree.toArrayInOrder());
+        assert(poolTree.countNodes() == 6);
+        poolTree.clear();
+        arenaTree.clear();
+        assert(arenaTree.isEmpty());
+        arenaTree.insert(1);
+        assert(arenaTree.countNodes() == 1);
+        // Двунаправленный итератор по родительским указателям
+        BinarySearchTree<int> walkTree;
+        for (int value : { 10, 5, 15, 2, 7, 12, 20 }) {
+            walkTree.insert(value);
+        }
+        walkTree.remove(5);
+        walkTree.remove(15);
+        vector<int> reversed(walkTree.rbegin(), walkTree.rend());
+        assert(reversed == vector<int>({ 20, 12, 10, 7, 2 }));
+        auto back = walkTree.end();
+        --back;
+        assert(*back == 20);
+        --back;
+        assert(*back == 12);
+        ++back;
+        ++back;
+        assert(back == walkTree.end());
+        auto front = walkTree.begin();
+        try {
+            --front;
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+        copyTree.copy(walkTree);
+        assert(vector<int>(copyTree.rbegin(), copyTree.rend()) == reversed);
+
+        // Удаление узла с двумя детьми переставляет узлы, а не копирует данные
+        TreeNode<int>* twelve = walkTree.search(12);
+        walkTree.remove(10);
+        assert(walkTree.get_root() == twelve && twelve->n_parent == nullptr);
+        assert(walkTree.toArrayInOrder() == vector<int>({ 2, 7, 12, 20 }));
+        assert(vector<int>(walkTree.rbegin(), walkTree.rend()) == vector<int>({ 20, 12, 7, 2 }));
+
+        // Вставка перемещением и создание на месте
+        BinarySearchTree<string> strings;
+        string moved = "moved string that does not fit into the small buffer";
+        strings.insert(std::move(moved));
+        assert(moved.empty());
+        assert(strings.emplace(3, 'z')->n_data == "zzz");
+        assert(strings.countNodes() == 2 && *strings.begin() == "moved string that does not fit into the small buffer");
+
+        // Потоковый вывод: элементы через пробел и дерево "лежа на боку"
+        std::ostringstream flat;
+        walkTree.write_to(flat);
+        assert(flat.str() == "2 7 12 20 ");
+        std::ostringstream layout;
+        walkTree.write_tree_to(layout);
+        assert(layout.str() == "    20\n12\n    7\n        2\n");
+
+        // Счетчики операций (TreeStats.h)
+        BinarySearchTree<int> counted;
+        for (int k : { 2, 1, 3, 4 }) {
+            counted.insert(k);
+        }
+        TreeStats insertStats = counted.stats();
+#ifdef AVLTREE_STATS
+        assert(insertStats.allocations == 4 && insertStats.comparisons == 4);
+        assert(insertStats.searches == 4 && insertStats.searchPathTotal == 4 && insertStats.searchPathMax == 2);
+        assert(counted.search(4) != nullptr && counted.stats().searchPathMax == 3);
+        counted.remove(1);
+        assert(counted.stats().frees == 1);
+        counted.resetStats();
+        int expectedValue = 2;
+        for (int value : counted) {
+            assert(value == expectedValue++);
+        }
+        assert(counted.stats().iteratorSteps == 3 && counted.stats().iteratorHopsMax == 3);
+        counted.clear();
+        assert(counted.stats().frees == 3);
+#else
+        assert(insertStats.comparisons == 0 && insertStats.allocations == 0 && insertStats.searches == 0);
+        counted.resetStats();
+#endif
         cout << "All tests passed!" << endl;
     }
 };
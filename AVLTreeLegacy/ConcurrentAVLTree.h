@@ -0,0 +1,539 @@
+#pragma once
+// Конкурентное AVL-дерево: читатели ищут без блокировок, писатели (по одному, под мьютексом) публикуют
+// новую версию одной атомарной записью корня. Опубликованные узлы неизменяемы: вставка и удаление
+// копируют только путь от корня (O(log2(n)) узлов), остальные узлы общие для старой и новой версий.
+// Замененные узлы освобождаются по эпохам: узел, выведенный из дерева в эпоху e, удаляется, когда
+// ни один читатель не находится в эпохе e или раньше.
+// Чтение O(log2(n)) без блокировок и записи в общую память, кроме своей ячейки эпохи
+// Вставка/удаление O(log2(n)) под мьютексом писателей
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AVLTreeLegacy.h"
+#include "ImmutableNodes.h"
+#include "ThreadSlots.h"
+
+// Эпохи читателей. Читатель занимает свободную ячейку, записывая в нее текущую эпоху (0 - ячейка
+// свободна), и освобождает ее по выходу. Ячейки в отдельных строках кэша, поэтому читатели разных
+// потоков не мешают друг другу.
+class EpochDomain {
+public:
+    static const size_t SLOTS = 128;
+
+    EpochDomain() : globalEpoch(1) {}
+
+    // Вход читателя: номер занятой ячейки
+    size_t enter() {
+        return claimThreadSlot<EpochDomain>(SLOTS, [this](size_t index) {
+            uint64_t expected = 0;
+            uint64_t epoch = globalEpoch.load(std::memory_order_seq_cst);
+            return slots[index].epoch.load(std::memory_order_relaxed) == 0
+                && slots[index].epoch.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst);
+        });
+    }
+
+    // Выход читателя из ячейки index
+    void exit(size_t index) {
+        slots[index].epoch.store(0, std::memory_order_release);
+    }
+
+    // Текущая эпоха (писатель помечает ею выведенные из дерева узлы)
+    uint64_t current() const {
+        return globalEpoch.load(std::memory_order_seq_cst);
+    }
+
+    // Переход к следующей эпохе. Возвращает наименьшую эпоху активных читателей (или новую эпоху, если
+    // читателей нет): узлы, выведенные раньше нее, никто уже не видит.
+    uint64_t advance() {
+        uint64_t next = globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+        uint64_t oldest = next;
+        for (const Slot& slot : slots) {
+            uint64_t epoch = slot.epoch.load(std::memory_order_seq_cst);
+            if (epoch != 0 && epoch < oldest) {
+                oldest = epoch;
+            }
+        }
+        return oldest;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{ 0 };
+    };
+
+    std::atomic<uint64_t> globalEpoch;
+    Slot slots[SLOTS];
+};
+
+template<typename T, typename Compare = std::less<T>>
+class ConcurrentAVLTree {
+private:
+    // Узел не меняется после публикации. version - номер записи, создавшей узел: узлы текущей записи
+    // еще никто не видел, и их можно удалять сразу.
+    struct Node {
+        T data;
+        const Node* left;
+        const Node* right;
+        int height;
+        size_t size;
+        uint64_t version;
+
+        Node(const T& n_data, const Node* n_left, const Node* n_right, uint64_t n_version)
+            : data(n_data), left(n_left), right(n_right),
+            height(1 + std::max(heightOf(n_left), heightOf(n_right))),
+            size(1 + sizeOf(n_left) + sizeOf(n_right)), version(n_version) {}
+    };
+
+public:
+    // Чтение под защитой эпохи: пока объект жив, узлы видимой им версии не освобождаются, поэтому
+    // указатели из find действительны. Долгое чтение задерживает освобождение памяти, но не писателей.
+    class ReadGuard {
+    public:
+        ReadGuard(const ConcurrentAVLTree& n_tree) : tree(&n_tree), slot(n_tree.epochs.enter()) {
+            root = n_tree.root.load(std::memory_order_seq_cst);
+        }
+
+        ReadGuard(ReadGuard&& other) noexcept : tree(other.tree), slot(other.slot), root(other.root) {
+            other.tree = nullptr;
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ReadGuard& operator=(ReadGuard&&) = delete;
+
+        ~ReadGuard() {
+            if (tree != nullptr) {
+                tree->epochs.exit(slot);
+            }
+        }
+
+        // Элемент с ключом key или nullptr. Log2N | Log2N | 1
+        template<typename Key>
+        const T* find(const Key& key) const {
+            const Node* current = root;
+            while (current != nullptr) {
+                int order = threeWayCompare(tree->comp, key, current->data);
+                if (order == 0) {
+                    return &current->data;
+                }
+                current = order < 0 ? current->left : current->right;
+            }
+            return nullptr;
+        }
+
+        template<typename Key>
+        bool contains(const Key& key) const {
+            return find(key) != nullptr;
+        }
+
+        // Число элементов видимой версии. O(1)
+        size_t size() const {
+            return sizeOf(root);
+        }
+
+        // Обход видимой версии по возрастанию; путь хранится в массиве на стеке. N | N | Log2N
+        template<typename F>
+        void for_each(F&& func) const {
+            forEachNode(root, func);
+        }
+
+        // Проверка балансировки и размеров видимой версии (для тестов). N | N | Log2N
+        bool checkBalance() const {
+            return checkNodes(root);
+        }
+
+    private:
+        const ConcurrentAVLTree* tree;
+        size_t slot;
+        const Node* root;
+    };
+
+    ConcurrentAVLTree(const Compare& compare = Compare()) : root(nullptr), comp(compare), version(0) {}
+
+    ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+
+    // Уничтожение: читателей быть не должно.
+    ~ConcurrentAVLTree() {
+        destroy(root.load(std::memory_order_relaxed));
+        for (const Retired& retired : retiredNodes) {
+            delete retired.node;
+        }
+    }
+
+    // Начать чтение (см. ReadGuard)
+    ReadGuard read() const {
+        return ReadGuard(*this);
+    }
+
+    // Есть ли элемент с ключом key. Без блокировок. Log2N | Log2N | 1
+    template<typename Key>
+    bool contains(const Key& key) const {
+        return read().contains(key);
+    }
+
+    // Число элементов. Без блокировок. O(1)
+    size_t size() const {
+        return read().size();
+    }
+
+    // Вставка копии value. Возвращает true, если элемента не было. Log2N | Log2N | Log2N
+    bool insert(const T& value) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        version++;
+        const Node* oldRoot = root.load(std::memory_order_relaxed);
+        bool inserted = false;
+        const Node* newRoot;
+        try {
+            newRoot = insertNode(oldRoot, value, inserted);
+        }
+        catch (...) {
+            abortWrite();
+            throw;
+        }
+        publish(newRoot);
+        return inserted;
+    }
+
+    // Удаление элемента с ключом key. Возвращает true, если элемент был. Log2N | Log2N | Log2N
+    template<typename Key>
+    bool remove(const Key& key) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        version++;
+        const Node* oldRoot = root.load(std::memory_order_relaxed);
+        bool removed = false;
+        const Node* newRoot;
+        try {
+            newRoot = removeNode(oldRoot, key, removed);
+        }
+        catch (...) {
+            abortWrite();
+            throw;
+        }
+        publish(newRoot);
+        return removed;
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        // Однопоточная проверка против std::set
+        ConcurrentAVLTree<int> tree;
+        std::set<int> model;
+        std::mt19937 rng(5);
+        for (int step = 0; step < 20000; step++) {
+            int key = static_cast<int>(rng() % 2000);
+            if (rng() % 3 == 0) {
+                assert(tree.remove(key) == (model.erase(key) == 1));
+            }
+            else {
+                assert(tree.insert(key) == model.insert(key).second);
+            }
+        }
+        {
+            ReadGuard guard = tree.read();
+            assert(guard.size() == model.size() && guard.checkBalance());
+            std::vector<int> values;
+            guard.for_each([&](const int& value) { values.push_back(value); });
+            assert(std::equal(values.begin(), values.end(), model.begin(), model.end()));
+        }
+
+        // Снимок читателя не меняется, пока писатель работает
+        ConcurrentAVLTree<int> shared;
+        for (int k = 0; k < 1000; k += 2) {
+            shared.insert(k);
+        }
+        {
+            ReadGuard before = shared.read();
+            const int* pinned = before.find(500);
+            shared.remove(500);
+            shared.insert(501);
+            assert(pinned != nullptr && *pinned == 500 && before.contains(500) && !before.contains(501));
+            assert(!shared.contains(500) && shared.contains(501));
+        }
+
+        // Запись, прерванная исключением (копирование значения на пути), не отдает живые узлы на освобождение
+        static int copiesLeft = -1;
+        struct FragileKey {
+            int key;
+            FragileKey(int n_key) : key(n_key) {}
+            FragileKey(const FragileKey& other) : key(other.key) {
+                if (copiesLeft >= 0 && copiesLeft-- == 0) {
+                    throw std::runtime_error("copy failed");
+                }
+            }
+            bool operator<(const FragileKey& other) const {
+                return key < other.key;
+            }
+        };
+        ConcurrentAVLTree<FragileKey> fragile;
+        for (int k = 0; k < 100; k++) {
+            fragile.insert(FragileKey(k * 2));
+        }
+        copiesLeft = 3; // Новый лист и два узла пути копируются, третий узел пути - нет
+        try {
+            fragile.insert(FragileKey(51));
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        copiesLeft = -1;
+        assert(!fragile.contains(FragileKey(51)) && fragile.insert(FragileKey(1001)));
+        {
+            auto guard = fragile.read();
+            assert(guard.size() == 101 && guard.checkBalance());
+            for (int k = 0; k < 100; k++) {
+                assert(guard.contains(FragileKey(k * 2)));
+            }
+        }
+
+        // Один писатель и несколько читателей: четные ключи есть всегда, нечетные появляются и исчезают
+        std::atomic<bool> done(false);
+        std::atomic<size_t> violations(0);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; r++) {
+            readers.emplace_back([&, r] {
+                std::mt19937 readerRng(r);
+                while (!done.load()) {
+                    ReadGuard guard = shared.read();
+                    int even = static_cast<int>(readerRng() % 500) * 2;
+                    if (even != 500 && !guard.contains(even)) {
+                        violations++;
+                    }
+                    if (readerRng() % 64 == 0 && !guard.checkBalance()) {
+                        violations++;
+                    }
+                }
+            });
+        }
+        for (int round = 0; round < 2000; round++) {
+            int odd = (round * 37 % 1000) | 1;
+            shared.insert(odd);
+            shared.remove(odd);
+        }
+        done = true;
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        assert(violations == 0);
+
+        std::cout << "ConcurrentAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    struct Retired {
+        const Node* node;
+        uint64_t epoch;
+    };
+
+    std::atomic<const Node*> root;
+    Compare comp;
+    mutable EpochDomain epochs;
+    std::mutex writeMutex;
+    // Номер текущей записи (см. Node::version)
+    uint64_t version;
+    // Узлы, выведенные из дерева, но, возможно, видимые читателям
+    std::vector<Retired> retiredNodes;
+    // Узлы текущей записи: созданные, созданные и уже ненужные, опубликованные и замененные. Замененные
+    // попадают в retiredNodes только при публикации: если запись прервется исключением, корень не
+    // заменится и эти узлы останутся в дереве.
+    std::vector<const Node*> createdNodes;
+    std::vector<const Node*> discardedNodes;
+    std::vector<const Node*> replacedNodes;
+
+    const Node* create(const Node* left, const T& data, const Node* right) {
+        createdNodes.reserve(createdNodes.size() + 1); // Чтобы после new не было исключения
+        const Node* node = new Node(data, left, right, version);
+        createdNodes.push_back(node);
+        return node;
+    }
+
+    // Узел node больше не входит в новую версию: свой (текущей записи) удаляется при публикации,
+    // опубликованный - при публикации откладывается до конца эпохи
+    void dispose(const Node* node) {
+        if (node->version == version) {
+            discardedNodes.push_back(node);
+        }
+        else {
+            replacedNodes.push_back(node);
+        }
+    }
+
+    // Откат записи, прерванной исключением: новые узлы никому не видны, дерево не менялось
+    void abortWrite() {
+        for (const Node* node : createdNodes) {
+            delete node;
+        }
+        createdNodes.clear();
+        discardedNodes.clear();
+        replacedNodes.clear();
+    }
+
+    // Сбалансированный узел из left, data и right; высоты left и right отличаются не больше чем на 2.
+    // Разобранные при поворотах узлы передаются в dispose. O(1)
+    const Node* balance(const Node* left, const T& data, const Node* right) {
+        int leftHeight = heightOf(left);
+        int rightHeight = heightOf(right);
+        if (leftHeight > rightHeight + 1) {
+            if (heightOf(left->left) >= heightOf(left->right)) {
+                // Одинарный правый поворот
+                const Node* result = create(left->left, left->data, create(left->right, data, right));
+                dispose(left);
+                return result;
+            }
+            // Большой правый поворот
+            const Node* middle = left->right;
+            const Node* result = create(create(left->left, left->data, middle->left), middle->data, create(middle->right, data, right));
+            dispose(middle);
+            dispose(left);
+            return result;
+        }
+        if (rightHeight > leftHeight + 1) {
+            if (heightOf(right->right) >= heightOf(right->left)) {
+                // Одинарный левый поворот
+                const Node* result = create(create(left, data, right->left), right->data, right->right);
+                dispose(right);
+                return result;
+            }
+            // Большой левый поворот
+            const Node* middle = right->left;
+            const Node* result = create(create(left, data, middle->left), middle->data, create(middle->right, right->data, right->right));
+            dispose(middle);
+            dispose(right);
+            return result;
+        }
+        return create(left, data, right);
+    }
+
+    // Вставка с копированием пути. Если элемент уже есть, возвращается тот же node. Log2N | Log2N | Log2N
+    const Node* insertNode(const Node* node, const T& value, bool& inserted) {
+        if (node == nullptr) {
+            inserted = true;
+            return create(nullptr, value, nullptr);
+        }
+        int order = threeWayCompare(comp, value, node->data);
+        if (order == 0) {
+            return node;
+        }
+        const Node* result;
+        if (order < 0) {
+            const Node* left = insertNode(node->left, value, inserted);
+            if (left == node->left) {
+                return node;
+            }
+            result = balance(left, node->data, node->right);
+        }
+        else {
+            const Node* right = insertNode(node->right, value, inserted);
+            if (right == node->right) {
+                return node;
+            }
+            result = balance(node->left, node->data, right);
+        }
+        dispose(node);
+        return result;
+    }
+
+    // Удаление самого левого узла: в minimum - этот узел (еще не переданный в dispose). Log2N | Log2N | Log2N
+    const Node* removeMin(const Node* node, const Node*& minimum) {
+        if (node->left == nullptr) {
+            minimum = node;
+            return node->right;
+        }
+        const Node* left = removeMin(node->left, minimum);
+        const Node* result = balance(left, node->data, node->right);
+        dispose(node);
+        return result;
+    }
+
+    // Удаление с копированием пути. Если ключа нет, возвращается тот же node. Log2N | Log2N | Log2N
+    template<typename Key>
+    const Node* removeNode(const Node* node, const Key& key, bool& removed) {
+        if (node == nullptr) {
+            return nullptr;
+        }
+        int order = threeWayCompare(comp, key, node->data);
+        const Node* result;
+        if (order < 0) {
+            const Node* left = removeNode(node->left, key, removed);
+            if (left == node->left) {
+                return node;
+            }
+            result = balance(left, node->data, node->right);
+        }
+        else if (order > 0) {
+            const Node* right = removeNode(node->right, key, removed);
+            if (right == node->right) {
+                return node;
+            }
+            result = balance(node->left, node->data, right);
+        }
+        else {
+            removed = true;
+            if (node->left == nullptr) {
+                result = node->right;
+            }
+            else if (node->right == nullptr) {
+                result = node->left;
+            }
+            else {
+                const Node* minimum;
+                const Node* right = removeMin(node->right, minimum);
+                result = balance(node->left, minimum->data, right);
+                dispose(minimum);
+            }
+        }
+        dispose(node);
+        return result;
+    }
+
+    // Публикация новой версии и освобождение узлов, которые уже никто не видит
+    void publish(const Node* newRoot) {
+        if (newRoot != root.load(std::memory_order_relaxed)) {
+            root.store(newRoot, std::memory_order_seq_cst);
+        }
+        for (const Node* node : discardedNodes) {
+            delete node;
+        }
+        uint64_t epoch = epochs.current();
+        for (const Node* node : replacedNodes) {
+            retiredNodes.push_back(Retired{ node, epoch });
+        }
+        createdNodes.clear();
+        discardedNodes.clear();
+        replacedNodes.clear();
+        if (retiredNodes.empty()) {
+            return;
+        }
+        uint64_t oldest = epochs.advance();
+        size_t kept = 0;
+        for (const Retired& retired : retiredNodes) {
+            if (retired.epoch < oldest) {
+                delete retired.node;
+            }
+            else {
+                retiredNodes[kept++] = retired;
+            }
+        }
+        retiredNodes.resize(kept);
+    }
+
+    void destroy(const Node* node) {
+        if (node == nullptr) {
+            return;
+        }
+        destroy(node->left);
+        destroy(node->right);
+        delete node;
+    }
+};
@@ -0,0 +1,296 @@
+#pragma once
+// AVL-дерево с плоским комбинированием (flat combining) для многих конкурирующих писателей.
+// Поток не захватывает мьютекс дерева на каждую операцию, а записывает ее в свою ячейку и ждет.
+// Тот поток, которому досталась блокировка комбинатора, собирает все ожидающие операции, сортирует
+// их по ключу и применяет пачкой: один пакетный поиск (find_batch) по различным ключам, затем
+// итоговые вставки и удаления - по одному insert_sorted и erase_sorted (split/join), после чего
+// раздает результаты. Дерево и мьютекс трогает только комбинатор, поэтому их строки кэша не
+// перебрасываются между ядрами.
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AVLTreeLegacy.h"
+#include "ThreadSlots.h"
+
+template<typename T, typename Compare = std::less<T>>
+class FlatCombiningAVLTree {
+public:
+    static const size_t SLOTS = 128;
+    // Сколько раз комбинатор подряд просматривает ячейки, пока находит новые операции
+    static const int COMBINE_PASSES = 4;
+
+    FlatCombiningAVLTree(const Compare& compare = Compare()) : tree(compare), comp(compare) {}
+
+    FlatCombiningAVLTree(const FlatCombiningAVLTree&) = delete;
+    FlatCombiningAVLTree& operator=(const FlatCombiningAVLTree&) = delete;
+
+    // Вставка копии value. Возвращает true, если элемента не было
+    bool insert(const T& value) {
+        return execute(Operation::Insert, value);
+    }
+
+    // Удаление value. Возвращает true, если элемент был
+    bool remove(const T& value) {
+        return execute(Operation::Remove, value);
+    }
+
+    // Есть ли элемент value
+    bool contains(const T& value) {
+        return execute(Operation::Contains, value);
+    }
+
+    // Число элементов. O(1)
+    size_t size() {
+        std::lock_guard<std::mutex> lock(combinerLock);
+        return tree.size();
+    }
+
+    // Обход по возрастанию под блокировкой комбинатора. N | N | 1
+    template<typename F>
+    void for_each(F&& func) {
+        std::lock_guard<std::mutex> lock(combinerLock);
+        tree.apply(func);
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        FlatCombiningAVLTree<int> tree;
+        assert(tree.insert(5) && !tree.insert(5) && tree.contains(5));
+        assert(tree.remove(5) && !tree.remove(5) && !tree.contains(5) && tree.size() == 0);
+
+        // Потоки вставляют пересекающиеся ключи: каждый ключ вставлен ровно одним потоком
+        FlatCombiningAVLTree<int> shared;
+        std::atomic<size_t> inserted(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t] {
+                for (int k = 0; k < 2000; k++) {
+                    inserted += shared.insert((k * 7 + t) % 4000);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        assert(inserted == shared.size() && shared.size() == 4000);
+
+        // Удаление каждого ключа засчитывается ровно одному потоку
+        std::atomic<size_t> removed(0);
+        threads.clear();
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t] {
+                for (int k = 0; k < 4000; k++) {
+                    removed += shared.remove((k + t * 500) % 4000);
+                    shared.contains(k);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        assert(removed == 4000 && shared.size() == 0);
+
+        // Повторы ключа в одной пачке: результаты в порядке операций, в дереве - итог
+        FlatCombiningAVLTree<int> repeated;
+        threads.clear();
+        std::atomic<int> balance(0);
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&] {
+                for (int k = 0; k < 1000; k++) {
+                    balance += repeated.insert(k % 10) ? 1 : 0;
+                    balance -= repeated.remove(k % 10) ? 1 : 0;
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        assert(balance == static_cast<int>(repeated.size()));
+
+        // Исключение операции (здесь - копирования ключа) доходит до вызвавшего потока, а комбинатор
+        // отпускает блокировку и продолжает работать
+        static bool failCopy = false;
+        struct FragileKey {
+            int key;
+            FragileKey(int n_key) : key(n_key) {}
+            FragileKey(const FragileKey& other) : key(other.key) {
+                if (failCopy) {
+                    throw std::runtime_error("copy failed");
+                }
+            }
+            FragileKey& operator=(const FragileKey&) = default;
+            bool operator<(const FragileKey& other) const {
+                return key < other.key;
+            }
+        };
+        FlatCombiningAVLTree<FragileKey> fragile;
+        assert(fragile.insert(FragileKey(1)));
+        failCopy = true;
+        try {
+            fragile.insert(FragileKey(2));
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        failCopy = false;
+        assert(fragile.size() == 1 && fragile.insert(FragileKey(2)) && fragile.contains(FragileKey(1)) && fragile.size() == 2);
+
+        std::cout << "FlatCombiningAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    enum class Operation { Insert, Remove, Contains };
+
+    // Состояния ячейки: свободна, заполняется владельцем, ждет комбинатора, выполнена
+    enum SlotState { Free, Claimed, Pending, Done };
+
+    // Ячейка операции; value указывает на аргумент ожидающего потока, error - исключение операции
+    struct alignas(64) Slot {
+        std::atomic<int> state{ Free };
+        Operation operation;
+        const T* value;
+        bool result;
+        std::exception_ptr error;
+    };
+
+    AVLTree<T, std::allocator<T>, Compare> tree;
+    Compare comp;
+    std::mutex combinerLock;
+    Slot slots[SLOTS];
+
+    bool execute(Operation operation, const T& value) {
+        Slot& slot = claimSlot();
+        slot.operation = operation;
+        slot.value = &value;
+        slot.error = nullptr;
+        slot.state.store(Pending, std::memory_order_release);
+        while (slot.state.load(std::memory_order_acquire) != Done) {
+            std::unique_lock<std::mutex> lock(combinerLock, std::try_to_lock);
+            if (lock.owns_lock()) {
+                combine();
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+        bool result = slot.result;
+        std::exception_ptr error = std::move(slot.error);
+        slot.state.store(Free, std::memory_order_release);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return result;
+    }
+
+    // Занять свободную ячейку, начиная с последней занятой этим потоком
+    Slot& claimSlot() {
+        size_t index = claimThreadSlot<FlatCombiningAVLTree>(SLOTS, [this](size_t candidate) {
+            int expected = Free;
+            return slots[candidate].state.load(std::memory_order_relaxed) == Free
+                && slots[candidate].state.compare_exchange_strong(expected, Claimed, std::memory_order_acquire);
+        });
+        return slots[index];
+    }
+
+    // Выполнение ожидающих операций пачками (вызывается под combinerLock). Исключения операций не выходят
+    // из комбинатора, а передаются владельцам ячеек.
+    void combine() {
+        std::vector<Slot*> batch;
+        for (int pass = 0; pass < COMBINE_PASSES; pass++) {
+            batch.clear();
+            for (Slot& slot : slots) {
+                if (slot.state.load(std::memory_order_acquire) == Pending) {
+                    batch.push_back(&slot);
+                }
+            }
+            if (batch.empty()) {
+                return;
+            }
+            applyBatch(batch);
+            for (Slot* slot : batch) {
+                slot->state.store(Done, std::memory_order_release);
+            }
+        }
+    }
+
+    // Пачка из B операций. Операции с одинаковым ключом выполняются в порядке номеров ячеек: их результаты
+    // вычисляются по наличию ключа до пачки, в дерево попадает только итог по каждому ключу.
+    // B*Log2(B) + B*Log2N (поиск) + M*Log2(N/M + 1) (изменения M ключей)
+    void applyBatch(std::vector<Slot*>& batch) {
+        std::stable_sort(batch.begin(), batch.end(), [this](const Slot* a, const Slot* b) {
+            return comp(*a->value, *b->value);
+        });
+        std::vector<T> keys;
+        std::vector<size_t> groupEnd; // Конец группы операций каждого ключа в batch
+        std::vector<T> added;
+        std::vector<T> removed;
+        std::vector<size_t> removedGroups;
+        try {
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (keys.empty() || comp(keys.back(), *batch[i]->value)) {
+                    keys.push_back(*batch[i]->value);
+                    groupEnd.push_back(i);
+                }
+                groupEnd.back() = i + 1;
+            }
+            std::vector<AVLTreeNode<T>*> found(keys.size());
+            tree.find_batch(keys, found);
+
+            size_t begin = 0;
+            for (size_t group = 0; group < keys.size(); group++) {
+                bool present = found[group] != nullptr;
+                for (size_t i = begin; i < groupEnd[group]; i++) {
+                    switch (batch[i]->operation) {
+                    case Operation::Insert:
+                        batch[i]->result = !present;
+                        present = true;
+                        break;
+                    case Operation::Remove:
+                        batch[i]->result = present;
+                        present = false;
+                        break;
+                    default:
+                        batch[i]->result = present;
+                        break;
+                    }
+                }
+                if (present && found[group] == nullptr) {
+                    added.push_back(keys[group]);
+                }
+                else if (!present && found[group] != nullptr) {
+                    removed.push_back(keys[group]);
+                    removedGroups.push_back(group);
+                }
+                begin = groupEnd[group];
+            }
+            tree.insert_sorted(added.begin(), added.end());
+        }
+        catch (...) {
+            // Дерево не изменилось: ошибка достается всем операциям пачки
+            for (Slot* slot : batch) {
+                slot->error = std::current_exception();
+            }
+            return;
+        }
+        try {
+            tree.erase_sorted(removed.begin(), removed.end());
+        }
+        catch (...) {
+            // Вставки уже применены, удаления - нет: ошибка достается операциям удаляемых ключей
+            for (size_t group : removedGroups) {
+                for (size_t i = group == 0 ? 0 : groupEnd[group - 1]; i < groupEnd[group]; i++) {
+                    batch[i]->error = std::current_exception();
+                }
+            }
+        }
+    }
+};
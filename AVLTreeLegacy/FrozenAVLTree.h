@@ -0,0 +1,177 @@
+#pragma once
+// Неизменяемый снимок дерева поиска для нагрузок "построил один раз - ищу много раз".
+// Элементы лежат в одном массиве в порядке Эйтцингера (обход дерева в ширину): корень в ячейке 1,
+// дети ячейки k - в ячейках 2k и 2k+1. Верхние уровни всех поисков попадают в одни и те же строки кэша,
+// спуск не разыменовывает указатели и не ветвится, а следующие уровни заранее подгружаются предвыборкой.
+// Построение O(n)
+// Поиск O(log2(n))
+#include "Prefetch.h"
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+// Поиск в массиве в порядке Эйтцингера. Не владеет памятью: массив может принадлежать FrozenAVLTree
+// или лежать в отображенном в память файле.
+template<typename T, typename Compare = std::less<T>>
+class EytzingerView {
+public:
+    // Сколько элементов помещается в строку кэша: через столько уровней спуск дойдет до подгруженной строки
+    static const size_t PREFETCH_STRIDE = sizeof(T) >= 64 ? 1 : 64 / sizeof(T);
+
+    EytzingerView() : items(nullptr), count(0), comp() {}
+
+    // items - массив из count элементов, ячейка k (с 1) хранится в items[k - 1]
+    EytzingerView(const T* n_items, size_t n_count, const Compare& compare = Compare()) : items(n_items), count(n_count), comp(compare) {}
+
+    // Номер (с 1) первого элемента, не меньшего key, или 0, если такого нет. Без ветвлений по данным. Log2N | Log2N | Log2N
+    template<typename Key>
+    size_t lowerBoundIndex(const Key& key) const {
+        size_t k = 1;
+        while (k <= count) {
+            prefetchRead(items + (k * PREFETCH_STRIDE - 1));
+            k = 2 * k + static_cast<size_t>(comp(items[k - 1], key));
+        }
+        // Последний поворот налево: отбрасываем хвост из поворотов направо и сам поворот
+        k >>= std::countr_one(k) + 1;
+        return k;
+    }
+
+    // Первый элемент, не меньший key, или nullptr. Log2N | Log2N | Log2N
+    template<typename Key>
+    const T* lower_bound(const Key& key) const {
+        size_t k = lowerBoundIndex(key);
+        return k == 0 ? nullptr : items + (k - 1);
+    }
+
+    // Элемент, равный key, или nullptr. Log2N | Log2N | Log2N
+    template<typename Key>
+    const T* find(const Key& key) const {
+        const T* candidate = lower_bound(key);
+        if (candidate == nullptr || comp(key, *candidate)) {
+            return nullptr;
+        }
+        return candidate;
+    }
+
+    // Есть ли элемент, равный key. Log2N | Log2N | Log2N
+    template<typename Key>
+    bool contains(const Key& key) const {
+        return find(key) != nullptr;
+    }
+
+    // Число элементов. O(1)
+    size_t size() const {
+        return count;
+    }
+
+    // Проверка на пустоту. O(1)
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    // Массив элементов в порядке Эйтцингера
+    const T* data() const {
+        return items;
+    }
+
+private:
+    const T* items;
+    size_t count;
+    Compare comp;
+};
+
+// Заполнение ячеек поддерева k массива items значениями из отсортированного диапазона по порядку (LNR). N | N | N
+template<typename T, typename It>
+void fillEytzinger(std::vector<T>& items, size_t k, It& it) {
+    if (k > items.size()) {
+        return;
+    }
+    fillEytzinger(items, 2 * k, it);
+    items[k - 1] = *it;
+    ++it;
+    fillEytzinger(items, 2 * k + 1, it);
+}
+
+// Владеющий снимок: массив в порядке Эйтцингера и поиск по нему.
+template<typename T, typename Compare = std::less<T>>
+class FrozenAVLTree {
+public:
+    FrozenAVLTree(const Compare& compare = Compare()) : comp(compare) {}
+
+    // Построение из отсортированного диапазона без повторов из count элементов. N | N | N
+    template<typename It>
+    FrozenAVLTree(It sortedFirst, size_t count, const Compare& compare = Compare()) : items(count), comp(compare) {
+        fillEytzinger(items, 1, sortedFirst);
+    }
+
+    // Поисковое представление снимка
+    EytzingerView<T, Compare> view() const {
+        return EytzingerView<T, Compare>(items.data(), items.size(), comp);
+    }
+
+    template<typename Key>
+    const T* lower_bound(const Key& key) const {
+        return view().lower_bound(key);
+    }
+
+    template<typename Key>
+    const T* find(const Key& key) const {
+        return view().find(key);
+    }
+
+    template<typename Key>
+    bool contains(const Key& key) const {
+        return view().contains(key);
+    }
+
+    size_t size() const {
+        return items.size();
+    }
+
+    bool isEmpty() const {
+        return items.empty();
+    }
+
+    // Массив элементов в порядке Эйтцингера
+    const std::vector<T>& data() const {
+        return items;
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        FrozenAVLTree<int> empty;
+        assert(empty.isEmpty() && !empty.contains(1) && empty.lower_bound(1) == nullptr);
+
+        // Все размеры от 1 до 100 (полные и неполные последние уровни)
+        for (int n = 1; n <= 100; n++) {
+            std::vector<int> sorted;
+            for (int k = 0; k < n; k++) {
+                sorted.push_back(k * 2);
+            }
+            FrozenAVLTree<int> frozen(sorted.begin(), sorted.size());
+            assert(frozen.size() == static_cast<size_t>(n));
+            for (int key = -1; key <= 2 * n; key++) {
+                auto expected = std::lower_bound(sorted.begin(), sorted.end(), key);
+                const int* found = frozen.lower_bound(key);
+                assert((expected == sorted.end()) == (found == nullptr));
+                assert(found == nullptr || *found == *expected);
+                assert(frozen.contains(key) == (key >= 0 && key % 2 == 0 && key < 2 * n));
+            }
+        }
+
+        // Обратный порядок
+        std::vector<int> descending = { 9, 7, 5, 3, 1 };
+        FrozenAVLTree<int, std::greater<int>> reversed(descending.begin(), descending.size());
+        assert(*reversed.lower_bound(6) == 5 && reversed.contains(9) && !reversed.contains(4));
+
+        std::cout << "FrozenAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    std::vector<T> items;
+    Compare comp;
+};
@@ -0,0 +1,277 @@
+#pragma once
+// Неизменяемый снимок для числовых ключей (int, float и т.п.): нижние уровни дерева упакованы в
+// отсортированные блоки размером в строку кэша (16 ключей по 4 байта, 8 ключей по 8 байт).
+// Блок выбирается поиском по максимумам блоков (массив в порядке Эйтцингера), внутри блока позиция
+// считается без ветвлений: число ключей меньше искомого. Для int и float этот подсчет выполняется
+// векторными сравнениями SSE2/AVX2 (набор инструкций выбирается при запуске), иначе - скалярным циклом.
+// Ключи NaN не поддерживаются.
+// Построение O(n)
+// Поиск O(log2(n / B) + B), B - ключей в блоке
+#include "FrozenAVLTree.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AVLTREE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Функции с AVX2 компилируются отдельно от остальной программы, которая может собираться без -mavx2
+#if defined(AVLTREE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define AVLTREE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AVLTREE_TARGET_AVX2
+#endif
+
+// Набор векторных инструкций для поиска внутри блока
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+// Лучший набор инструкций, поддерживаемый процессором. Определяется один раз.
+inline SimdLevel detectSimdLevel() {
+#if defined(AVLTREE_X86)
+    static const SimdLevel level = [] {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        // CPUID.1:ECX: бит 28 - AVX, бит 27 - OSXSAVE (только тогда можно спрашивать XGETBV о регистрах YMM)
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool osSavesYmm = avx && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        bool avx2 = osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        return avx2 ? SimdLevel::AVX2 : SimdLevel::SSE2;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Число ключей блока из count элементов, меньших key. Без ветвлений. B | B | 1
+template<typename T, size_t count>
+size_t countLessScalar(const T* block, T key) {
+    size_t less = 0;
+    for (size_t i = 0; i < count; i++) {
+        less += static_cast<size_t>(block[i] < key);
+    }
+    return less;
+}
+
+#if defined(AVLTREE_X86)
+// Блок из 16 int: четыре сравнения по 4 ключа
+inline size_t countLessSse2(const int* block, int key) {
+    __m128i needle = _mm_set1_epi32(key);
+    unsigned mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128i keys = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 4 * i));
+        mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle, keys)))) << (4 * i);
+    }
+    return std::popcount(mask);
+}
+
+inline size_t countLessSse2(const float* block, float key) {
+    __m128 needle = _mm_set1_ps(key);
+    unsigned mask = 0;
+    for (int i = 0; i < 4; i++) {
+        __m128 keys = _mm_loadu_ps(block + 4 * i);
+        mask |= static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(keys, needle))) << (4 * i);
+    }
+    return std::popcount(mask);
+}
+
+// Блок из 16 int: два сравнения по 8 ключей
+AVLTREE_TARGET_AVX2 inline size_t countLessAvx2(const int* block, int key) {
+    __m256i needle = _mm256_set1_epi32(key);
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 8));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, low))))
+        | static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(needle, high)))) << 8;
+    return std::popcount(mask);
+}
+
+AVLTREE_TARGET_AVX2 inline size_t countLessAvx2(const float* block, float key) {
+    __m256 needle = _mm256_set1_ps(key);
+    __m256 low = _mm256_loadu_ps(block);
+    __m256 high = _mm256_loadu_ps(block + 8);
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(low, needle, _CMP_LT_OQ)))
+        | static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(high, needle, _CMP_LT_OQ))) << 8;
+    return std::popcount(mask);
+}
+#endif
+
+// Ядро подсчета для типа T и набора инструкций level. Векторные ядра есть только для блоков из 16 int или float.
+template<typename T, size_t count>
+auto selectCountLess(SimdLevel level) -> size_t(*)(const T*, T) {
+#if defined(AVLTREE_X86)
+    if constexpr (count == 16 && (std::is_same<T, int>::value || std::is_same<T, float>::value)) {
+        if (level == SimdLevel::AVX2) {
+            return static_cast<size_t(*)(const T*, T)>(&countLessAvx2);
+        }
+        if (level == SimdLevel::SSE2) {
+            return static_cast<size_t(*)(const T*, T)>(&countLessSse2);
+        }
+    }
+#endif
+    (void)level;
+    return &countLessScalar<T, count>;
+}
+
+template<typename T>
+class FrozenKeyBlocks {
+    static_assert(std::is_arithmetic<T>::value, "FrozenKeyBlocks requires an arithmetic key type");
+
+public:
+    // Ключей в блоке: блок занимает одну строку кэша
+    static const size_t BLOCK_KEYS = 64 / sizeof(T);
+
+    FrozenKeyBlocks() : count(0), countLess(&countLessScalar<T, BLOCK_KEYS>), simd(SimdLevel::Scalar) {}
+
+    // Построение из отсортированного по возрастанию диапазона без повторов из n элементов. Векторный
+    // поиск используется не выше maxLevel и не выше того, что поддерживает процессор. N | N | N
+    template<typename It>
+    FrozenKeyBlocks(It sortedFirst, size_t n, SimdLevel maxLevel = SimdLevel::AVX2) : count(n) {
+        size_t blockCount = (n + BLOCK_KEYS - 1) / BLOCK_KEYS;
+        std::vector<T> sorted(blockCount * BLOCK_KEYS, paddingKey());
+        for (size_t i = 0; i < n; i++, ++sortedFirst) {
+            sorted[i] = *sortedFirst;
+        }
+        std::vector<T> maxima(blockCount);
+        for (size_t b = 0; b < blockCount; b++) {
+            maxima[b] = sorted[std::min(n, (b + 1) * BLOCK_KEYS) - 1];
+        }
+        topKeys = FrozenAVLTree<T>(maxima.begin(), blockCount);
+
+        // Блоки переставляются в тот же порядок, что и их максимумы: ячейка k верхнего уровня
+        // сразу указывает на свой блок, без таблицы номеров
+        std::vector<size_t> order(blockCount);
+        std::vector<size_t> blockIds(blockCount);
+        std::iota(blockIds.begin(), blockIds.end(), 0);
+        auto ids = blockIds.begin();
+        fillEytzinger(order, 1, ids);
+        keys.resize(sorted.size());
+        for (size_t slot = 0; slot < blockCount; slot++) {
+            std::copy_n(sorted.begin() + order[slot] * BLOCK_KEYS, BLOCK_KEYS, keys.begin() + slot * BLOCK_KEYS);
+        }
+        setLevel(maxLevel);
+    }
+
+    // Выбор набора инструкций (не выше поддерживаемого процессором)
+    void setLevel(SimdLevel maxLevel) {
+        simd = std::min(maxLevel, detectSimdLevel());
+        countLess = selectCountLess<T, BLOCK_KEYS>(simd);
+    }
+
+    // Используемый набор инструкций
+    SimdLevel level() const {
+        return simd;
+    }
+
+    // Первый ключ, не меньший key, или nullptr. Log2(N/B) + B | Log2(N/B) + B | 1
+    const T* lower_bound(T key) const {
+        size_t slot = topKeys.view().lowerBoundIndex(key);
+        if (slot == 0) {
+            return nullptr;
+        }
+        const T* first = keys.data() + (slot - 1) * BLOCK_KEYS;
+        return first + countLess(first, key);
+    }
+
+    // Ключ, равный key, или nullptr. Log2(N/B) + B | Log2(N/B) + B | 1
+    const T* find(T key) const {
+        const T* candidate = lower_bound(key);
+        return candidate != nullptr && !(key < *candidate) ? candidate : nullptr;
+    }
+
+    // Есть ли ключ key. Log2(N/B) + B | Log2(N/B) + B | 1
+    bool contains(T key) const {
+        return find(key) != nullptr;
+    }
+
+    // Число ключей. O(1)
+    size_t size() const {
+        return count;
+    }
+
+    // Проверка на пустоту. O(1)
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    // Функция тестирования: все наборы инструкций дают одинаковые ответы
+    static void runTests() {
+        FrozenKeyBlocks<int> empty;
+        assert(empty.isEmpty() && !empty.contains(0) && empty.lower_bound(0) == nullptr);
+
+        const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 };
+        for (SimdLevel level : levels) {
+            for (int n = 1; n <= 70; n++) {
+                std::vector<int> sorted;
+                for (int k = 0; k < n; k++) {
+                    sorted.push_back(k * 3 - 50);
+                }
+                FrozenKeyBlocks<int> blocks(sorted.begin(), sorted.size(), level);
+                assert(blocks.size() == static_cast<size_t>(n) && blocks.level() <= level);
+                for (int key = -52; key <= 3 * n - 48; key++) {
+                    auto expected = std::lower_bound(sorted.begin(), sorted.end(), key);
+                    const int* found = blocks.lower_bound(key);
+                    assert((expected == sorted.end()) == (found == nullptr));
+                    assert(found == nullptr || *found == *expected);
+                    assert(blocks.contains(key) == (expected != sorted.end() && *expected == key));
+                }
+            }
+
+            // Крайние значения: ключ, равный заполнителю последнего блока
+            std::vector<int> extremes = { std::numeric_limits<int>::min(), 0, std::numeric_limits<int>::max() };
+            FrozenKeyBlocks<int> edge(extremes.begin(), extremes.size(), level);
+            assert(edge.contains(std::numeric_limits<int>::max()) && edge.contains(std::numeric_limits<int>::min()));
+            assert(!edge.contains(1) && *edge.lower_bound(1) == std::numeric_limits<int>::max());
+
+            std::vector<float> reals = { -2.5f, -1.0f, 0.0f, 0.25f, 3.0f, 1e9f };
+            FrozenKeyBlocks<float> floats(reals.begin(), reals.size(), level);
+            assert(floats.contains(0.25f) && !floats.contains(0.5f) && *floats.lower_bound(0.5f) == 3.0f);
+            assert(floats.lower_bound(2e9f) == nullptr);
+        }
+
+        // 8-байтовые ключи: блоки по 8, скалярный подсчет
+        std::vector<long long> wide;
+        for (long long k = 0; k < 1000; k++) {
+            wide.push_back(k * 1000000007LL);
+        }
+        FrozenKeyBlocks<long long> wideBlocks(wide.begin(), wide.size());
+        assert(FrozenKeyBlocks<long long>::BLOCK_KEYS == 8);
+        assert(wideBlocks.contains(999 * 1000000007LL) && !wideBlocks.contains(5));
+
+        std::cout << "FrozenKeyBlocks tests passed!" << std::endl;
+    }
+
+private:
+    // Блоки отсортированных ключей (последний дополнен максимальным значением типа) в порядке topKeys
+    std::vector<T> keys;
+    // Максимумы блоков в порядке Эйтцингера
+    FrozenAVLTree<T> topKeys;
+    size_t count;
+    size_t (*countLess)(const T*, T);
+    SimdLevel simd;
+
+    static T paddingKey() {
+        if constexpr (std::numeric_limits<T>::has_infinity) {
+            return std::numeric_limits<T>::infinity();
+        }
+        else {
+            return std::numeric_limits<T>::max();
+        }
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+// Общие функции для узлов без ссылок на родителя, которые разделяются версиями дерева и не меняются после
+// публикации (PersistentAVLTree, ConcurrentAVLTree). Узел - любая структура с полями data, left, right,
+// height и size (высота и размер поддерева).
+#include <algorithm>
+#include <cstddef>
+
+// Высота поддерева node (пустого - 0). O(1)
+template<typename Node>
+int heightOf(const Node* node) {
+    return node == nullptr ? 0 : node->height;
+}
+
+// Число узлов поддерева node. O(1)
+template<typename Node>
+size_t sizeOf(const Node* node) {
+    return node == nullptr ? 0 : node->size;
+}
+
+// Проверка балансировки, высот и размеров поддерева node (для тестов). N | N | Log2N
+template<typename Node>
+bool checkNodes(const Node* node) {
+    if (node == nullptr) {
+        return true;
+    }
+    int balanceFactor = heightOf(node->left) - heightOf(node->right);
+    return balanceFactor >= -1 && balanceFactor <= 1
+        && node->height == 1 + std::max(heightOf(node->left), heightOf(node->right))
+        && node->size == 1 + sizeOf(node->left) + sizeOf(node->right)
+        && checkNodes(node->left) && checkNodes(node->right);
+}
+
+// Применение func к данным поддерева root по возрастанию; путь хранится в массиве на стеке. N | N | Log2N
+template<typename Node, typename F>
+void forEachNode(const Node* root, F& func) {
+    // Максимальная высота AVL-дерева (см. AVLTree::MAX_HEIGHT)
+    const Node* path[96];
+    int depth = 0;
+    const Node* current = root;
+    while (current != nullptr || depth > 0) {
+        while (current != nullptr) {
+            path[depth++] = current;
+            current = current->left;
+        }
+        current = path[--depth];
+        func(current->data);
+        current = current->right;
+    }
+}
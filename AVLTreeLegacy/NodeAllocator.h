@@ -0,0 +1,288 @@
+#pragma once
+// Распределители памяти для узлов деревьев.
+// Деревья принимают распределитель шаблонным параметром (по умолчанию std::allocator) и
+// перепривязывают его к типу узла через std::allocator_traits. Подходят std::allocator,
+// std::pmr::polymorphic_allocator и распределители из этого файла:
+//   NodePoolAllocator - пул со списками свободных слотов, узлы берутся из больших блоков;
+//   ArenaAllocator    - монотонная арена: освобождение узла ничего не делает, а clear()
+//                       дерева отдает всю память разом за O(1).
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Пул слотов фиксированных размеров. Размеры округляются до alignof(max_align_t), для каждого
+// класса размера ведется свой список свободных слотов. Память блоков возвращается системе
+// только при уничтожении пула.
+class NodePool {
+public:
+    // Шаг классов размера
+    static const size_t GRANULE = alignof(std::max_align_t);
+    // Число классов размера; более крупные запросы уходят в ::operator new
+    static const size_t SIZE_CLASSES = 16;
+    // Число слотов в одном блоке
+    static const size_t SLOTS_PER_BLOCK = 256;
+
+    NodePool() {
+        for (size_t i = 0; i < SIZE_CLASSES; i++) {
+            freeLists[i] = nullptr;
+        }
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() {
+        for (void* block : blocks) {
+            ::operator delete(block);
+        }
+    }
+
+    // Выделение bytes байт. 1 | Log2N (рост блоков) | 1
+    void* allocate(size_t bytes) {
+        size_t sizeClass = (bytes + GRANULE - 1) / GRANULE;
+        if (sizeClass == 0 || sizeClass > SIZE_CLASSES) {
+            return ::operator new(bytes);
+        }
+        FreeSlot*& head = freeLists[sizeClass - 1];
+        if (head == nullptr) {
+            grow(sizeClass);
+        }
+        FreeSlot* slot = head;
+        head = slot->next;
+        return slot;
+    }
+
+    // Возврат слота в список свободных. 1 | 1 | 1
+    void deallocate(void* pointer, size_t bytes) {
+        size_t sizeClass = (bytes + GRANULE - 1) / GRANULE;
+        if (sizeClass == 0 || sizeClass > SIZE_CLASSES) {
+            ::operator delete(pointer);
+            return;
+        }
+        FreeSlot* slot = static_cast<FreeSlot*>(pointer);
+        slot->next = freeLists[sizeClass - 1];
+        freeLists[sizeClass - 1] = slot;
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    // Новый блок для класса размера sizeClass, все его слоты попадают в список свободных
+    void grow(size_t sizeClass) {
+        size_t slotSize = sizeClass * GRANULE;
+        char* block = static_cast<char*>(::operator new(slotSize * SLOTS_PER_BLOCK));
+        blocks.push_back(block);
+        FreeSlot* head = freeLists[sizeClass - 1];
+        for (size_t i = SLOTS_PER_BLOCK; i > 0; i--) {
+            FreeSlot* slot = reinterpret_cast<FreeSlot*>(block + (i - 1) * slotSize);
+            slot->next = head;
+            head = slot;
+        }
+        freeLists[sizeClass - 1] = head;
+    }
+
+    FreeSlot* freeLists[SIZE_CLASSES];
+    std::vector<void*> blocks;
+};
+
+// Монотонная арена: выделение сдвигом указателя внутри текущего блока, освобождение отдельных
+// объектов не поддерживается, release() отдает все блоки сразу.
+class MonotonicArena {
+public:
+    // Размер первого блока; каждый следующий вдвое больше, но не больше MAX_BLOCK
+    static const size_t FIRST_BLOCK = 4096;
+    static const size_t MAX_BLOCK = 1 << 20;
+
+    MonotonicArena() : current(nullptr), left(0), nextBlockSize(FIRST_BLOCK) {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    ~MonotonicArena() {
+        release();
+    }
+
+    // Выделение bytes байт с выравниванием alignment. 1 | 1 | 1
+    void* allocate(size_t bytes, size_t alignment) {
+        size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(current) % alignment) % alignment;
+        if (current == nullptr || padding + bytes > left) {
+            size_t blockSize = nextBlockSize;
+            while (blockSize < bytes + alignment) {
+                blockSize *= 2;
+            }
+            if (nextBlockSize < MAX_BLOCK) {
+                nextBlockSize *= 2;
+            }
+            current = static_cast<char*>(::operator new(blockSize));
+            left = blockSize;
+            blocks.push_back(current);
+            padding = (alignment - reinterpret_cast<std::uintptr_t>(current) % alignment) % alignment;
+        }
+        void* result = current + padding;
+        current += padding + bytes;
+        left -= padding + bytes;
+        return result;
+    }
+
+    // Освобождение всех блоков. Число блоков логарифмически зависит от объема памяти
+    void release() {
+        for (void* block : blocks) {
+            ::operator delete(block);
+        }
+        blocks.clear();
+        current = nullptr;
+        left = 0;
+        nextBlockSize = FIRST_BLOCK;
+    }
+
+private:
+    char* current;
+    size_t left;
+    size_t nextBlockSize;
+    std::vector<void*> blocks;
+};
+
+// Распределитель на основе NodePool. Копии и перепривязанные копии разделяют один пул.
+// Перемещение передает пул (вместе с узлами дерева при перемещающем присваивании); перемещенный
+// распределитель заводит новый пул при следующем выделении.
+template<typename T>
+class NodePoolAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    static_assert(alignof(T) <= NodePool::GRANULE, "NodePoolAllocator: over-aligned types are not supported");
+
+    NodePoolAllocator() : pool(std::make_shared<NodePool>()) {}
+
+    template<typename U>
+    NodePoolAllocator(const NodePoolAllocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        if (pool == nullptr) {
+            pool = std::make_shared<NodePool>();
+        }
+        return static_cast<T*>(pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t n) {
+        pool->deallocate(pointer, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const NodePoolAllocator<U>& other) const {
+        return pool == other.pool;
+    }
+
+    template<typename U>
+    bool operator!=(const NodePoolAllocator<U>& other) const {
+        return pool != other.pool;
+    }
+
+    std::shared_ptr<NodePool> pool;
+};
+
+// Распределитель на основе MonotonicArena. Копии и перепривязанные копии разделяют одну арену.
+// Перемещение передает арену, не добавляя ей владельца (см. releaseIfExclusive); перемещенный
+// распределитель заводит новую арену при следующем выделении.
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    ArenaAllocator() : arena(std::make_shared<MonotonicArena>()) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena == nullptr) {
+            arena = std::make_shared<MonotonicArena>();
+        }
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // Освобождение отдельных объектов в арене ничего не делает
+    void deallocate(T*, size_t) {}
+
+    // Освободить всю арену, если ей пользуется только этот распределитель.
+    // Возвращает false, если у арены есть другие владельцы (тогда память остается занятой до их уничтожения).
+    bool releaseIfExclusive() {
+        if (arena.use_count() != 1) {
+            return false;
+        }
+        arena->release();
+        return true;
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+
+    std::shared_ptr<MonotonicArena> arena;
+};
+
+// Освободить все узлы дерева разом, не обходя его. Возвращает true, если распределитель это сделал
+// (или освобождение отдельных узлов для него ничего не значит). Общий случай - нельзя.
+template<typename Alloc>
+bool releaseAllNodes(Alloc&) {
+    return false;
+}
+
+// Арена освобождается целиком за O(1)
+template<typename U>
+bool releaseAllNodes(ArenaAllocator<U>& alloc) {
+    return alloc.releaseIfExclusive();
+}
+
+// Для монотонного pmr-ресурса освобождение узлов ничего не делает, память вернет владелец ресурса
+template<typename U>
+bool releaseAllNodes(std::pmr::polymorphic_allocator<U>& alloc) {
+    return dynamic_cast<std::pmr::monotonic_buffer_resource*>(alloc.resource()) != nullptr;
+}
+
+// Можно ли выделять и освобождать узлы распределителем из нескольких потоков одновременно (нужно
+// параллельным операциям деревьев; с остальными распределителями они выполняются последовательно).
+// Пул и арена из этого файла не синхронизированы.
+template<typename Alloc>
+struct IsThreadSafeAllocator : std::false_type {};
+
+template<typename U>
+struct IsThreadSafeAllocator<std::allocator<U>> : std::true_type {};
+
+// Создание узла через распределитель alloc с аргументами конструктора args
+template<typename NodeAlloc, typename... Args>
+typename std::allocator_traits<NodeAlloc>::value_type* allocateNode(NodeAlloc& alloc, Args&&... args) {
+    using Traits = std::allocator_traits<NodeAlloc>;
+    typename Traits::value_type* node = Traits::allocate(alloc, 1);
+    try {
+        Traits::construct(alloc, node, std::forward<Args>(args)...);
+    }
+    catch (...) {
+        Traits::deallocate(alloc, node, 1);
+        throw;
+    }
+    return node;
+}
+
+// Уничтожение узла, созданного allocateNode
+template<typename NodeAlloc>
+void freeNode(NodeAlloc& alloc, typename std::allocator_traits<NodeAlloc>::value_type* node) {
+    using Traits = std::allocator_traits<NodeAlloc>;
+    Traits::destroy(alloc, node);
+    Traits::deallocate(alloc, node, 1);
+}
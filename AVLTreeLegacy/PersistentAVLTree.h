@@ -0,0 +1,481 @@
+#pragma once
+// Персистентное AVL-дерево: снимок (копия дерева) стоит O(1) - новая версия разделяет с ним все узлы.
+// Узлы считают ссылки на себя. Узел, на который ссылается только изменяемая версия, меняется на месте;
+// общий узел перед изменением заменяется копией, разделяющей детей с оригиналом. Поэтому вставка и
+// удаление копируют не больше O(log2(n)) узлов пути, а без снимков не копируют ничего.
+// Снимок не меняется, его можно читать и обходить из другого потока без блокировок, пока писатель
+// меняет исходное дерево (сам объект дерева, как и любой объект, из нескольких потоков не меняется).
+// Снимок O(1)
+// Вставка/удаление O(log2(n))
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AVLTreeLegacy.h"
+#include "ImmutableNodes.h"
+
+template<typename T, typename Compare = std::less<T>>
+class PersistentAVLTree {
+private:
+    struct Node {
+        T data;
+        Node* left;
+        Node* right;
+        int height;
+        size_t size;
+        // Число ссылок на узел: от родителей в разных версиях и от корней версий
+        std::atomic<size_t> refs;
+
+        Node(const T& n_data, Node* n_left, Node* n_right) : data(n_data), left(n_left), right(n_right), height(1), size(1), refs(1) {
+            update(this);
+        }
+    };
+
+public:
+    PersistentAVLTree(const Compare& compare = Compare()) : root(nullptr), comp(compare) {}
+
+    // Копия - снимок: общий корень. O(1)
+    PersistentAVLTree(const PersistentAVLTree& other) : root(acquire(other.root)), comp(other.comp) {}
+
+    PersistentAVLTree(PersistentAVLTree&& other) noexcept : root(other.root), comp(other.comp) {
+        other.root = nullptr;
+    }
+
+    PersistentAVLTree& operator=(const PersistentAVLTree& other) {
+        if (this != &other) {
+            Node* previous = root;
+            root = acquire(other.root);
+            comp = other.comp;
+            release(previous);
+        }
+        return *this;
+    }
+
+    PersistentAVLTree& operator=(PersistentAVLTree&& other) noexcept {
+        if (this != &other) {
+            release(root);
+            root = other.root;
+            comp = other.comp;
+            other.root = nullptr;
+        }
+        return *this;
+    }
+
+    ~PersistentAVLTree() {
+        release(root);
+    }
+
+    // Неизменяемый снимок текущей версии. O(1)
+    PersistentAVLTree snapshot() const {
+        return *this;
+    }
+
+    // Вставка копии value. Возвращает true, если элемента не было. Log2N | Log2N | Log2N
+    bool insert(const T& value) {
+        if (contains(value)) {
+            return false; // Не копируем путь впустую
+        }
+        try {
+            root = insertNode(root, value);
+        }
+        catch (...) {
+            abortWrite();
+            throw;
+        }
+        commitWrite();
+        return true;
+    }
+
+    // Удаление элемента с ключом key. Возвращает true, если элемент был. Log2N | Log2N | Log2N
+    template<typename Key>
+    bool remove(const Key& key) {
+        if (!contains(key)) {
+            return false;
+        }
+        try {
+            root = removeNode(root, key);
+        }
+        catch (...) {
+            abortWrite();
+            throw;
+        }
+        commitWrite();
+        return true;
+    }
+
+    // Элемент с ключом key или nullptr. Указатель действителен до изменения этой версии. Log2N | Log2N | 1
+    template<typename Key>
+    const T* find(const Key& key) const {
+        const Node* current = root;
+        while (current != nullptr) {
+            int order = threeWayCompare(comp, key, current->data);
+            if (order == 0) {
+                return &current->data;
+            }
+            current = order < 0 ? current->left : current->right;
+        }
+        return nullptr;
+    }
+
+    template<typename Key>
+    bool contains(const Key& key) const {
+        return find(key) != nullptr;
+    }
+
+    // Число элементов. O(1)
+    size_t size() const {
+        return root == nullptr ? 0 : root->size;
+    }
+
+    // Проверка на пустоту. O(1)
+    bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // Высота дерева. O(1)
+    int getTreeHeight() const {
+        return root == nullptr ? 0 : root->height;
+    }
+
+    // Удаление всех элементов этой версии (снимки не меняются)
+    void clear() {
+        release(root);
+        root = nullptr;
+    }
+
+    // Обход по возрастанию; путь хранится в массиве на стеке. N | N | Log2N
+    template<typename F>
+    void for_each(F&& func) const {
+        forEachNode(root, func);
+    }
+
+    // Проверка балансировки и размеров (для тестов). N | N | Log2N
+    bool checkBalance() const {
+        return checkNodes(root);
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        // Случайные операции со снимками; каждый снимок сверяется со своей копией std::set
+        PersistentAVLTree<int> tree;
+        std::set<int> model;
+        std::vector<std::pair<PersistentAVLTree<int>, std::set<int>>> versions;
+        std::mt19937 rng(3);
+        for (int step = 0; step < 20000; step++) {
+            int key = static_cast<int>(rng() % 1000);
+            if (rng() % 3 == 0) {
+                assert(tree.remove(key) == (model.erase(key) == 1));
+            }
+            else {
+                assert(tree.insert(key) == model.insert(key).second);
+            }
+            if (step % 1000 == 0) {
+                versions.emplace_back(tree.snapshot(), model);
+            }
+        }
+        versions.emplace_back(tree, model);
+        for (const auto& version : versions) {
+            std::vector<int> values;
+            version.first.for_each([&](const int& value) { values.push_back(value); });
+            assert(version.first.checkBalance() && version.first.size() == version.second.size());
+            assert(std::equal(values.begin(), values.end(), version.second.begin(), version.second.end()));
+        }
+
+        // Изменение снимка не затрагивает оригинал
+        PersistentAVLTree<int> original;
+        for (int k = 0; k < 100; k++) {
+            original.insert(k);
+        }
+        PersistentAVLTree<int> copy = original.snapshot();
+        copy.remove(50);
+        copy.insert(1000);
+        assert(original.contains(50) && !original.contains(1000) && original.size() == 100);
+        assert(!copy.contains(50) && copy.contains(1000) && copy.size() == 100);
+        copy = std::move(original);
+        assert(copy.contains(50) && original.isEmpty());
+
+        // Обход снимка в другом потоке, пока писатель меняет дерево
+        PersistentAVLTree<int> live;
+        for (int k = 0; k < 10000; k++) {
+            live.insert(k);
+        }
+        PersistentAVLTree<int> frozen = live.snapshot();
+        long long sum = 0;
+        std::thread reader([&] {
+            for (int pass = 0; pass < 10; pass++) {
+                frozen.for_each([&](const int& value) { sum += value; });
+            }
+        });
+        for (int k = 0; k < 10000; k += 2) {
+            live.remove(k);
+            live.insert(k + 20000);
+        }
+        reader.join();
+        assert(sum == 10LL * 10000 * 9999 / 2);
+        assert(live.size() == 10000 && !live.contains(0) && live.contains(20000) && live.checkBalance());
+
+        // Копия элемента бросает исключение на каждом шаге вставки и удаления по очереди: версия и
+        // снимок остаются прежними, и после ухода снимка дерево цело
+        static int copiesLeft = 0;
+        struct FragileKey {
+            int key;
+            FragileKey(int n_key) : key(n_key) {}
+            FragileKey(const FragileKey& other) : key(other.key) {
+                if (copiesLeft > 0 && --copiesLeft == 0) {
+                    throw std::runtime_error("copy failed");
+                }
+            }
+            FragileKey& operator=(const FragileKey&) = default;
+            bool operator<(const FragileKey& other) const {
+                return key < other.key;
+            }
+        };
+        for (bool withSnapshot : { true, false }) {
+            for (int operation = 0; operation < 3; operation++) {
+                for (int failAt = 1; ; failAt++) {
+                    PersistentAVLTree<FragileKey> fragile;
+                    for (int k = 0; k < 15; k++) {
+                        fragile.insert(FragileKey(k * 2));
+                    }
+                    bool threw = false;
+                    {
+                        PersistentAVLTree<FragileKey> kept;
+                        if (withSnapshot) {
+                            kept = fragile.snapshot();
+                        }
+                        copiesLeft = failAt;
+                        try {
+                            if (operation == 0) {
+                                fragile.insert(FragileKey(7));
+                            }
+                            else {
+                                fragile.remove(FragileKey(operation == 1 ? 14 : 2)); // Корень с двумя детьми и лист
+                            }
+                        }
+                        catch (const std::runtime_error&) {
+                            threw = true;
+                        }
+                        copiesLeft = 0;
+                        assert(!withSnapshot || (kept.size() == 15 && kept.checkBalance()));
+                    }
+                    std::vector<int> keys;
+                    fragile.for_each([&](const FragileKey& value) { keys.push_back(value.key); });
+                    assert(fragile.checkBalance() && keys.size() == fragile.size());
+                    assert(std::is_sorted(keys.begin(), keys.end()));
+                    assert(fragile.size() == (threw ? 15u : operation == 0 ? 16u : 14u));
+                    if (!threw) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::cout << "PersistentAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    // Прежние поля узла: изменяемого (для отката) или созданного (его исходные дети, на которые он взял ссылки)
+    struct SavedNode {
+        Node* node;
+        Node* left;
+        Node* right;
+        int height;
+        size_t size;
+    };
+
+    Node* root;
+    Compare comp;
+
+    // Записи текущего изменения. Общие узлы, замененные копиями, освобождаются, а удаленные узлы
+    // удаляются только после успешного завершения: если копия T бросит исключение на середине пути,
+    // изменяемые узлы получают прежние поля, созданные узлы удаляются, и версия остается прежней.
+    std::vector<SavedNode> savedNodes;
+    std::vector<SavedNode> createdNodes;
+    std::vector<Node*> releasedNodes;
+    std::vector<Node*> removedNodes;
+
+    static int balanceOf(const Node* node) {
+        return heightOf(node->left) - heightOf(node->right);
+    }
+
+    static void update(Node* node) {
+        node->height = 1 + std::max(heightOf(node->left), heightOf(node->right));
+        node->size = 1 + sizeOf(node->left) + sizeOf(node->right);
+    }
+
+    static Node* acquire(Node* node) {
+        if (node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    // Освобождение ссылки; узел без ссылок удаляется вместе со ссылками на детей. Log2N | N | Log2N
+    static void release(Node* node) {
+        if (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->left);
+            release(node->right);
+            delete node;
+        }
+    }
+
+    // Узел, который можно менять: сам node, если на него больше никто не ссылается (его поля
+    // запоминаются для отката), иначе его копия с общими детьми (ссылка на node освобождается при
+    // завершении изменения). O(1)
+    Node* own(Node* node) {
+        if (node->refs.load(std::memory_order_acquire) == 1) {
+            savedNodes.push_back(SavedNode{ node, node->left, node->right, node->height, node->size });
+            return node;
+        }
+        releasedNodes.reserve(releasedNodes.size() + 1);
+        Node* copy = create(node->data, node->left, node->right);
+        releasedNodes.push_back(node);
+        return copy;
+    }
+
+    // Новый узел текущего изменения; ссылки на детей берутся, только когда узел создан. O(1)
+    Node* create(const T& data, Node* left, Node* right) {
+        createdNodes.reserve(createdNodes.size() + 1);
+        Node* node = new Node(data, left, right);
+        createdNodes.push_back(SavedNode{ node, acquire(left), acquire(right), 0, 0 });
+        return node;
+    }
+
+    // Завершение изменения: освобождение ссылок на замененные общие узлы и удаление удаленных. Log2N | Log2N | 1
+    void commitWrite() {
+        for (Node* node : releasedNodes) {
+            release(node);
+        }
+        for (Node* node : removedNodes) {
+            delete node; // Изменяемый узел: ссылок, кроме нашей, не было
+        }
+        forgetWrite();
+    }
+
+    // Откат прерванного изменения: прежние поля изменяемых узлов (с конца, чтобы остались самые первые),
+    // удаление созданных узлов и их ссылок на детей. Log2N | Log2N | 1
+    void abortWrite() {
+        for (auto it = savedNodes.rbegin(); it != savedNodes.rend(); ++it) {
+            it->node->left = it->left;
+            it->node->right = it->right;
+            it->node->height = it->height;
+            it->node->size = it->size;
+        }
+        for (const SavedNode& created : createdNodes) {
+            release(created.left);
+            release(created.right);
+            delete created.node;
+        }
+        forgetWrite();
+    }
+
+    void forgetWrite() {
+        savedNodes.clear();
+        createdNodes.clear();
+        releasedNodes.clear();
+        removedNodes.clear();
+    }
+
+    // Повороты и балансировка изменяемого узла node
+    Node* rotateRight(Node* node) {
+        Node* left = own(node->left);
+        node->left = left->right;
+        left->right = node;
+        update(node);
+        update(left);
+        return left;
+    }
+
+    Node* rotateLeft(Node* node) {
+        Node* right = own(node->right);
+        node->right = right->left;
+        right->left = node;
+        update(node);
+        update(right);
+        return right;
+    }
+
+    Node* balance(Node* node) {
+        update(node);
+        int factor = balanceOf(node);
+        if (factor > 1) {
+            if (balanceOf(node->left) < 0) {
+                node->left = rotateLeft(own(node->left));
+            }
+            return rotateRight(node);
+        }
+        if (factor < -1) {
+            if (balanceOf(node->right) > 0) {
+                node->right = rotateRight(own(node->right));
+            }
+            return rotateLeft(node);
+        }
+        return node;
+    }
+
+    // Вставка value (его нет в поддереве) в поддерево node, ссылкой на которое владеет вызывающий.
+    // Возвращает ссылку на новое поддерево. Log2N | Log2N | Log2N
+    Node* insertNode(Node* node, const T& value) {
+        if (node == nullptr) {
+            return create(value, nullptr, nullptr);
+        }
+        node = own(node);
+        if (comp(value, node->data)) {
+            node->left = insertNode(node->left, value);
+        }
+        else {
+            node->right = insertNode(node->right, value);
+        }
+        return balance(node);
+    }
+
+    // Отделение самого левого узла (изменяемого) в minimum. Log2N | Log2N | Log2N
+    Node* removeMin(Node* node, Node*& minimum) {
+        node = own(node);
+        if (node->left == nullptr) {
+            minimum = node;
+            Node* right = node->right;
+            node->right = nullptr;
+            return right;
+        }
+        node->left = removeMin(node->left, minimum);
+        return balance(node);
+    }
+
+    // Удаление key (он есть в поддереве) из поддерева node. Log2N | Log2N | Log2N
+    template<typename Key>
+    Node* removeNode(Node* node, const Key& key) {
+        node = own(node);
+        int order = threeWayCompare(comp, key, node->data);
+        if (order < 0) {
+            node->left = removeNode(node->left, key);
+            return balance(node);
+        }
+        if (order > 0) {
+            node->right = removeNode(node->right, key);
+            return balance(node);
+        }
+        removedNodes.push_back(node); // Удаляется при завершении изменения
+        Node* left = node->left;
+        Node* right = node->right;
+        if (left == nullptr) {
+            return right;
+        }
+        if (right == nullptr) {
+            return left;
+        }
+        Node* minimum;
+        right = removeMin(right, minimum);
+        minimum->left = left;
+        minimum->right = right;
+        return balance(minimum);
+    }
+};
@@ -0,0 +1,17 @@
+#pragma once
+// Программная предвыборка данных в кэш.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Подсказка процессору загрузить в кэш строку с адресом address (для чтения). Не бросает
+// исключений и не обращается к памяти, поэтому годится и для адресов за концом массива.
+inline void prefetchRead(const void* address) {
+#if defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#else
+    (void)address;
+#endif
+}
@@ -0,0 +1,198 @@
+#pragma once
+// Множество, разбитое на Shards независимых AVL-деревьев по хешу ключа, у каждого свой мьютекс.
+// Писатели с разными ключами почти всегда попадают в разные деревья и не ждут друг друга, а ячейки
+// шардов лежат в отдельных строках кэша. Упорядоченный обход сливает шарды k-путевым слиянием.
+// Вставка/поиск/удаление O(log2(n / Shards)) под мьютексом одного шарда
+// Упорядоченный обход O(n log2(Shards)) под мьютексами всех шардов
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AVLTreeLegacy.h"
+
+template<typename T, size_t Shards = 16, typename Hash = std::hash<T>, typename Compare = std::less<T>>
+class ShardedAVLTree {
+    static_assert(Shards > 0, "ShardedAVLTree needs at least one shard");
+
+public:
+    ShardedAVLTree(const Hash& n_hash = Hash(), const Compare& compare = Compare()) : hash(n_hash), comp(compare) {
+        for (Shard& shard : shards) {
+            shard.tree = AVLTree<T, std::allocator<T>, Compare>(compare);
+        }
+    }
+
+    ShardedAVLTree(const ShardedAVLTree&) = delete;
+    ShardedAVLTree& operator=(const ShardedAVLTree&) = delete;
+
+    // Вставка копии value. Возвращает true, если элемента не было. Log2N | Log2N | 1
+    bool insert(const T& value) {
+        Shard& shard = shardOf(value);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.tree.emplace(value).second;
+    }
+
+    // Удаление value. Возвращает true, если элемент был. Log2N | Log2N | 1
+    bool remove(const T& value) {
+        Shard& shard = shardOf(value);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        if (shard.tree.findNode(value) == nullptr) {
+            return false;
+        }
+        shard.tree.remove(value);
+        return true;
+    }
+
+    // Есть ли элемент value. Log2N | Log2N | 1
+    bool contains(const T& value) const {
+        const Shard& shard = shardOf(value);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.tree.findNode(value) != nullptr;
+    }
+
+    // Число элементов (шарды блокируются по очереди, поэтому при одновременных изменениях результат
+    // приблизительный). O(Shards)
+    size_t size() const {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            total += shard.tree.size();
+        }
+        return total;
+    }
+
+    bool isEmpty() const {
+        return size() == 0;
+    }
+
+    // Число элементов в шарде index (для проверки равномерности разбиения). O(1)
+    size_t shardSize(size_t index) const {
+        std::lock_guard<std::mutex> lock(shards[index].lock);
+        return shards[index].tree.size();
+    }
+
+    // Удаление всех элементов
+    void clear() {
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            shard.tree.clear();
+        }
+    }
+
+    // Обход всех элементов по возрастанию: k-путевое слияние шардов через кучу их текущих элементов.
+    // Все шарды блокируются (в порядке номеров) на время обхода, поэтому обход видит согласованное
+    // состояние. N log2(Shards) | N log2(Shards) | Shards
+    template<typename F>
+    void for_each(F&& func) const {
+        std::unique_lock<std::mutex> locks[Shards];
+        for (size_t i = 0; i < Shards; i++) {
+            locks[i] = std::unique_lock<std::mutex>(shards[i].lock);
+        }
+        using Iterator = typename AVLTree<T, std::allocator<T>, Compare>::Iterator;
+        Iterator current[Shards];
+        Iterator last[Shards];
+        // В куче номера шардов; наверху шард с наименьшим текущим элементом
+        auto greater = [&](size_t a, size_t b) { return comp(*current[b], *current[a]); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+        for (size_t i = 0; i < Shards; i++) {
+            current[i] = shards[i].tree.begin();
+            last[i] = shards[i].tree.end();
+            if (current[i] != last[i]) {
+                heap.push(i);
+            }
+        }
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+            func(*current[i]);
+            if (++current[i] != last[i]) {
+                heap.push(i);
+            }
+        }
+    }
+
+    // Все элементы по возрастанию. N log2(Shards) | N log2(Shards) | N
+    std::vector<T> toVector() const {
+        std::vector<T> values;
+        for_each([&](const T& value) { values.push_back(value); });
+        return values;
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        ShardedAVLTree<int, 8> sharded;
+        assert(sharded.isEmpty() && !sharded.remove(1));
+        for (int k = 999; k >= 0; k--) {
+            assert(sharded.insert(k));
+        }
+        assert(!sharded.insert(500) && sharded.size() == 1000);
+        for (size_t i = 0; i < 8; i++) {
+            assert(sharded.shardSize(i) > 60); // Последовательные ключи распределяются равномерно
+        }
+        std::vector<int> values = sharded.toVector();
+        for (int k = 0; k < 1000; k++) {
+            assert(values[k] == k);
+        }
+        assert(sharded.remove(500) && !sharded.contains(500) && sharded.contains(501));
+
+        // Писатели с пересекающимися ключами из нескольких потоков
+        ShardedAVLTree<int> shared;
+        std::vector<std::thread> writers;
+        for (int w = 0; w < 4; w++) {
+            writers.emplace_back([&, w] {
+                for (int k = 0; k < 5000; k++) {
+                    shared.insert(k * 2 + (w % 2));
+                }
+            });
+        }
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        values = shared.toVector();
+        assert(values.size() == 10000);
+        for (int k = 0; k < 10000; k++) {
+            assert(values[k] == k);
+        }
+
+        // Обратный порядок при обходе
+        ShardedAVLTree<int, 4, std::hash<int>, std::greater<int>> reversed;
+        for (int k = 0; k < 100; k++) {
+            reversed.insert(k);
+        }
+        values = reversed.toVector();
+        assert(values.front() == 99 && values.back() == 0 && std::is_sorted(values.rbegin(), values.rend()));
+
+        std::cout << "ShardedAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    struct alignas(64) Shard {
+        mutable std::mutex lock;
+        AVLTree<T, std::allocator<T>, Compare> tree;
+    };
+
+    Shard shards[Shards];
+    Hash hash;
+    Compare comp;
+
+    // Шард ключа. Хеш перемешивается умножением (std::hash для целых - тождественная функция), старшие
+    // биты произведения равномерны даже для последовательных ключей. O(1)
+    size_t shardIndex(const T& value) const {
+        uint64_t mixed = static_cast<uint64_t>(hash(value)) * 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>((mixed >> 32) % Shards);
+    }
+
+    Shard& shardOf(const T& value) {
+        return shards[shardIndex(value)];
+    }
+
+    const Shard& shardOf(const T& value) const {
+        return shards[shardIndex(value)];
+    }
+};
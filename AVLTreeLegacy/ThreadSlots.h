@@ -0,0 +1,25 @@
+#pragma once
+// Захват ячейки в массиве ячеек, общих для потоков (эпохи читателей, ячейки операций комбинатора).
+// Поток начинает с ячейки, занятой им в прошлый раз (в первый раз - с ячейки по хешу id потока),
+// поэтому при малом числе потоков у каждого своя ячейка и захват удается с первой попытки.
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+// Номер ячейки из slotCount, которую занял вызов tryClaim(index) (true - ячейка занята этим потоком).
+// Если свободных ячеек нет, поток уступает процессор после каждого круга. Tag разделяет стартовые
+// позиции потоков для разных массивов ячеек.
+template<typename Tag, typename TryClaim>
+size_t claimThreadSlot(size_t slotCount, TryClaim&& tryClaim) {
+    static thread_local size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t attempt = 0; ; attempt++) {
+        size_t index = (start + attempt) % slotCount;
+        if (tryClaim(index)) {
+            start = index;
+            return index;
+        }
+        if (attempt % slotCount == slotCount - 1) {
+            std::this_thread::yield(); // Все ячейки заняты
+        }
+    }
+}
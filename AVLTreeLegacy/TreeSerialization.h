@@ -0,0 +1,382 @@
+#pragma once
+// Двоичный формат дерева для быстрого холодного старта вместо разбора текстовых дампов.
+// Файл: заголовок из 64 байт (сигнатура, версия формата, раскладка, размер элемента, число элементов,
+// метка порядка байтов), за ним - массив элементов без указателей. Раскладки:
+//  - Sorted: элементы по возрастанию, загрузка строит сбалансированное дерево за O(n) (assignSorted);
+//  - Eytzinger: элементы в порядке Эйтцингера (см. FrozenAVLTree.h), файл отображается в память,
+//    и поиск идет прямо по отображению, без копирования и без построения дерева.
+// Поддерживаются только тривиально копируемые элементы: они пишутся как есть, в порядке байтов машины.
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AVLTreeLegacy.h"
+#include "FrozenAVLTree.h"
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Раскладка элементов в файле
+enum class TreeLayout : uint32_t { Sorted = 0, Eytzinger = 1 };
+
+// Заголовок файла. Размер 64 байта, чтобы массив элементов начинался с границы строки кэша.
+struct TreeFileHeader {
+    static const uint32_t MAGIC = 0x544C5641; // "AVLT"
+    static const uint32_t VERSION = 1;
+    static const uint32_t ENDIAN_MARK = 0x01020304;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;
+    uint32_t elementSize;
+    uint64_t count;
+    uint32_t endianMark;
+    uint8_t reserved[36];
+
+    // Проверка заголовка файла размером fileSize с элементами размера elementSize
+    void validate(size_t expectedElementSize, uint64_t fileSize) const {
+        if (magic != MAGIC) {
+            throw std::runtime_error("Not an AVL tree file");
+        }
+        if (version != VERSION) {
+            throw std::runtime_error("Unsupported tree file version");
+        }
+        if (endianMark != ENDIAN_MARK) {
+            throw std::runtime_error("Tree file has foreign byte order");
+        }
+        if (elementSize != expectedElementSize) {
+            throw std::runtime_error("Tree file element size mismatch");
+        }
+        if (layout != static_cast<uint32_t>(TreeLayout::Sorted) && layout != static_cast<uint32_t>(TreeLayout::Eytzinger)) {
+            throw std::runtime_error("Unknown tree file layout");
+        }
+        if (count > (fileSize - sizeof(TreeFileHeader)) / expectedElementSize) {
+            throw std::runtime_error("Tree file is truncated");
+        }
+    }
+};
+
+static_assert(sizeof(TreeFileHeader) == 64, "Tree file header must be 64 bytes");
+
+// Запись элементов дерева в файл path в раскладке layout. N | N | N (для Eytzinger; Sorted - 1)
+template<typename T, typename Alloc, typename Compare>
+void saveTree(const AVLTree<T, Alloc, Compare>& tree, const std::string& path, TreeLayout layout = TreeLayout::Eytzinger) {
+    static_assert(std::is_trivially_copyable<T>::value, "saveTree needs trivially copyable elements");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path + " for writing");
+    }
+    TreeFileHeader header = {};
+    header.magic = TreeFileHeader::MAGIC;
+    header.version = TreeFileHeader::VERSION;
+    header.layout = static_cast<uint32_t>(layout);
+    header.elementSize = sizeof(T);
+    header.count = tree.size();
+    header.endianMark = TreeFileHeader::ENDIAN_MARK;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (layout == TreeLayout::Eytzinger) {
+        std::vector<T> items(tree.size());
+        auto it = tree.begin();
+        fillEytzinger(items, 1, it);
+        out.write(reinterpret_cast<const char*>(items.data()), static_cast<std::streamsize>(items.size() * sizeof(T)));
+    }
+    else {
+        for (const T& value : tree) {
+            out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+    }
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+// Индексы Эйтцингера поддерева k по возрастанию (LNR): восстановление порядка. N | N | Log2N
+template<typename F>
+void forEachEytzingerIndex(size_t count, F&& func) {
+    size_t k = 1;
+    while (2 * k <= count) {
+        k *= 2;
+    }
+    for (size_t visited = 0; visited < count; visited++) {
+        func(k);
+        // Преемник: самый левый узел правого поддерева, иначе - первый предок, в который пришли слева
+        if (2 * k + 1 <= count) {
+            k = 2 * k + 1;
+            while (2 * k <= count) {
+                k *= 2;
+            }
+        }
+        else {
+            k >>= std::countr_one(k) + 1;
+        }
+    }
+}
+
+// Отображение файла в память только для чтения
+class MappedFile {
+public:
+    MappedFile() : address(nullptr), length(0) {}
+
+    explicit MappedFile(const std::string& path) : address(nullptr), length(0) {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            throw std::runtime_error("Cannot map empty file " + path);
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            throw std::runtime_error("Cannot map " + path);
+        }
+        address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (address == nullptr) {
+            throw std::runtime_error("Cannot map " + path);
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        struct stat info;
+        if (::fstat(file, &info) != 0 || info.st_size == 0) {
+            ::close(file);
+            throw std::runtime_error("Cannot map empty file " + path);
+        }
+        void* mapped = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, file, 0);
+        ::close(file);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Cannot map " + path);
+        }
+        address = mapped;
+        length = static_cast<size_t>(info.st_size);
+#endif
+    }
+
+    MappedFile(MappedFile&& other) noexcept : address(other.address), length(other.length) {
+        other.address = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            address = other.address;
+            length = other.length;
+            other.address = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        unmap();
+    }
+
+    const unsigned char* data() const {
+        return static_cast<const unsigned char*>(address);
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    void* address;
+    size_t length;
+
+    void unmap() {
+        if (address == nullptr) {
+            return;
+        }
+#if defined(_WIN32)
+        UnmapViewOfFile(address);
+#else
+        ::munmap(address, length);
+#endif
+        address = nullptr;
+    }
+};
+
+// Чтение файла в дерево: сбалансированное построение из отсортированных элементов (любая раскладка).
+// Порядок элементов проверяется: поврежденный или чужой файл не превратится в неверное дерево. N | N | N
+template<typename T, typename Alloc = std::allocator<T>, typename Compare = std::less<T>>
+AVLTree<T, Alloc, Compare> loadTree(const std::string& path) {
+    static_assert(std::is_trivially_copyable<T>::value, "loadTree needs trivially copyable elements");
+    MappedFile file(path);
+    if (file.size() < sizeof(TreeFileHeader)) {
+        throw std::runtime_error("Tree file is truncated");
+    }
+    TreeFileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    header.validate(sizeof(T), file.size());
+    size_t count = static_cast<size_t>(header.count);
+    const unsigned char* items = file.data() + sizeof(TreeFileHeader);
+    std::vector<T> sorted(count);
+    if (count == 0) {
+        return AVLTree<T, Alloc, Compare>();
+    }
+    if (header.layout == static_cast<uint32_t>(TreeLayout::Sorted)) {
+        std::memcpy(sorted.data(), items, count * sizeof(T));
+    }
+    else {
+        size_t next = 0;
+        forEachEytzingerIndex(count, [&](size_t k) {
+            std::memcpy(&sorted[next++], items + (k - 1) * sizeof(T), sizeof(T));
+        });
+    }
+    if (!std::is_sorted(sorted.begin(), sorted.end(), Compare())) {
+        throw std::runtime_error("Tree file elements are out of order");
+    }
+    AVLTree<T, Alloc, Compare> tree;
+    tree.assignSorted(sorted.begin(), sorted.end());
+    return tree;
+}
+
+// Дерево, отображенное из файла в раскладке Eytzinger: поиск идет по отображенной памяти без копирования.
+// Открытие O(1) (страницы подгружаются по мере обращения); поиск O(log2(n)).
+template<typename T, typename Compare = std::less<T>>
+class MappedAVLTree {
+    static_assert(std::is_trivially_copyable<T>::value, "MappedAVLTree needs trivially copyable elements");
+
+public:
+    explicit MappedAVLTree(const std::string& path, const Compare& compare = Compare()) : file(path) {
+        if (file.size() < sizeof(TreeFileHeader)) {
+            throw std::runtime_error("Tree file is truncated");
+        }
+        const TreeFileHeader* header = reinterpret_cast<const TreeFileHeader*>(file.data());
+        header->validate(sizeof(T), file.size());
+        if (header->layout != static_cast<uint32_t>(TreeLayout::Eytzinger)) {
+            throw std::runtime_error("Tree file is not in Eytzinger layout");
+        }
+        items = EytzingerView<T, Compare>(reinterpret_cast<const T*>(file.data() + sizeof(TreeFileHeader)),
+            static_cast<size_t>(header->count), compare);
+    }
+
+    // Поисковое представление отображенного массива (действительно, пока жив объект)
+    EytzingerView<T, Compare> view() const {
+        return items;
+    }
+
+    template<typename Key>
+    const T* lower_bound(const Key& key) const {
+        return items.lower_bound(key);
+    }
+
+    template<typename Key>
+    const T* find(const Key& key) const {
+        return items.find(key);
+    }
+
+    template<typename Key>
+    bool contains(const Key& key) const {
+        return items.contains(key);
+    }
+
+    size_t size() const {
+        return items.size();
+    }
+
+    bool isEmpty() const {
+        return items.isEmpty();
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        std::string path = "avltree_serialization_test.bin";
+        for (int n : { 0, 1, 2, 7, 8, 1000 }) {
+            std::vector<int> sorted;
+            for (int k = 0; k < n; k++) {
+                sorted.push_back(k * 3);
+            }
+            AVLTree<int> tree;
+            tree.assignSorted(sorted.begin(), sorted.end());
+
+            for (TreeLayout layout : { TreeLayout::Sorted, TreeLayout::Eytzinger }) {
+                saveTree(tree, path, layout);
+                AVLTree<int> loaded = loadTree<int>(path);
+                assert(loaded.size() == tree.size() && loaded.checkHeights());
+                assert(std::equal(loaded.begin(), loaded.end(), sorted.begin(), sorted.end()));
+            }
+
+            MappedAVLTree<int> mapped(path);
+            assert(mapped.size() == static_cast<size_t>(n));
+            for (int key = -1; key <= 3 * n; key++) {
+                assert(mapped.contains(key) == (key >= 0 && key % 3 == 0 && key < 3 * n));
+            }
+        }
+
+        // Поврежденные и чужие файлы отвергаются
+        saveTree(AVLTree<int>(), path, TreeLayout::Sorted);
+        bool rejected = false;
+        try {
+            MappedAVLTree<int> wrongLayout(path);
+        }
+        catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+        rejected = false;
+        try {
+            loadTree<long long>(path);
+        }
+        catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        // Элементы не по порядку (первый ключ заменен большим) - в обеих раскладках
+        AVLTree<int> three;
+        three.insert(0);
+        three.insert(3);
+        three.insert(6);
+        for (TreeLayout layout : { TreeLayout::Sorted, TreeLayout::Eytzinger }) {
+            saveTree(three, path, layout);
+            {
+                std::fstream patch(path, std::ios::binary | std::ios::in | std::ios::out);
+                int large = 100;
+                patch.seekp(sizeof(TreeFileHeader));
+                patch.write(reinterpret_cast<const char*>(&large), sizeof(large));
+            }
+            try {
+                loadTree<int>(path);
+                assert(false);
+            }
+            catch (const std::runtime_error&) {}
+        }
+        std::remove(path.c_str());
+
+        std::cout << "MappedAVLTree tests passed!" << std::endl;
+    }
+
+private:
+    MappedFile file;
+    EytzingerView<T, Compare> items;
+};
@@ -0,0 +1,153 @@
+#pragma once
+// Встроенные счетчики деревьев AVLTree и BinarySearchTree: сравнения ключей, одинарные и двойные
+// повороты, выделения и освобождения узлов, длина пути поиска от корня, шаги итераторов.
+// Включаются макросом AVLTREE_STATS (определить до подключения заголовков или собрать с опцией
+// CMake -DAVLTREE_STATS=ON). Без макроса счетчиков в деревьях и итераторах нет: размер объектов и
+// код операций не меняются, stats() возвращает нули, resetStats() ничего не делает.
+// С макросом счетчики - атомарные с порядком relaxed, поэтому счет точен и при одновременных поисках
+// читателей под общим замком. Чтобы читатели не перебрасывали друг другу строку кэша счетчиков на
+// каждом узле, операции копят счет в локальных переменных и прибавляют его один раз в конце.
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+
+// Инструкция, которая выполняется только при включенных счетчиках (аргументы иначе не вычисляются)
+#ifdef AVLTREE_STATS
+#define AVLTREE_STAT(...) __VA_ARGS__
+#else
+#define AVLTREE_STAT(...) ((void)0)
+#endif
+
+// Снимок счетчиков дерева.
+struct TreeStats {
+    // Сравнений ключей
+    uint64_t comparisons = 0;
+    // Одинарных и двойных (большие повороты) поворотов при балансировке
+    uint64_t singleRotations = 0;
+    uint64_t doubleRotations = 0;
+    // Выделенных и освобожденных деревом узлов
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    // Спусков от корня (поиск, вставка, удаление), суммарная и наибольшая длина их путей в узлах
+    uint64_t searches = 0;
+    uint64_t searchPathTotal = 0;
+    uint64_t searchPathMax = 0;
+    // Шагов итераторов, переходов по указателям за все шаги и наибольшее число переходов за шаг.
+    // Итераторы ходят по родительским указателям без стека; наибольший шаг - это глубина, которую
+    // занял бы стек итератора со стеком.
+    uint64_t iteratorSteps = 0;
+    uint64_t iteratorHops = 0;
+    uint64_t iteratorHopsMax = 0;
+
+    // Средняя длина пути поиска
+    double averageSearchPath() const {
+        return searches == 0 ? 0.0 : static_cast<double>(searchPathTotal) / static_cast<double>(searches);
+    }
+
+    // Среднее число переходов на шаг итератора (для полного обхода меньше 2)
+    double averageIteratorHops() const {
+        return iteratorSteps == 0 ? 0.0 : static_cast<double>(iteratorHops) / static_cast<double>(iteratorSteps);
+    }
+};
+
+// Счетчики одного дерева. Копия дерева начинает счет с нуля, присваивание счетчики не переносит.
+class TreeCounters {
+public:
+    TreeCounters() = default;
+
+    TreeCounters(const TreeCounters&) {}
+
+    TreeCounters& operator=(const TreeCounters&) {
+        return *this;
+    }
+
+    void countComparisons(uint64_t count) {
+        comparisons.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void countRotation(bool isDouble) {
+        (isDouble ? doubleRotations : singleRotations).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void countAllocations(uint64_t count) {
+        allocations.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void countFrees(uint64_t count) {
+        frees.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Спуск от корня через length узлов с одним сравнением ключа на узел. Эти сравнения не прибавляются
+    // к comparisons отдельно: snapshot складывает их из длины путей.
+    void recordSearch(uint64_t length) {
+        searches.fetch_add(1, std::memory_order_relaxed);
+        searchPathTotal.fetch_add(length, std::memory_order_relaxed);
+        raise(searchPathMax, length);
+    }
+
+    // Шаг итератора за hops переходов
+    void recordStep(uint64_t hops) {
+        iteratorSteps.fetch_add(1, std::memory_order_relaxed);
+        iteratorHops.fetch_add(hops, std::memory_order_relaxed);
+        raise(iteratorHopsMax, hops);
+    }
+
+    TreeStats snapshot() const {
+        TreeStats result;
+        result.comparisons = comparisons.load(std::memory_order_relaxed) + searchPathTotal.load(std::memory_order_relaxed);
+        result.singleRotations = singleRotations.load(std::memory_order_relaxed);
+        result.doubleRotations = doubleRotations.load(std::memory_order_relaxed);
+        result.allocations = allocations.load(std::memory_order_relaxed);
+        result.frees = frees.load(std::memory_order_relaxed);
+        result.searches = searches.load(std::memory_order_relaxed);
+        result.searchPathTotal = searchPathTotal.load(std::memory_order_relaxed);
+        result.searchPathMax = searchPathMax.load(std::memory_order_relaxed);
+        result.iteratorSteps = iteratorSteps.load(std::memory_order_relaxed);
+        result.iteratorHops = iteratorHops.load(std::memory_order_relaxed);
+        result.iteratorHopsMax = iteratorHopsMax.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    void reset() {
+        for (std::atomic<uint64_t>* counter : { &comparisons, &singleRotations, &doubleRotations, &allocations, &frees,
+                                                &searches, &searchPathTotal, &searchPathMax,
+                                                &iteratorSteps, &iteratorHops, &iteratorHopsMax }) {
+            counter->store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    // Поднять максимум до value. Запись только при новом максимуме, поэтому обычно это одно чтение.
+    static void raise(std::atomic<uint64_t>& maximum, uint64_t value) {
+        uint64_t current = maximum.load(std::memory_order_relaxed);
+        while (current < value && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Сравнения вне спусков recordSearch
+    std::atomic<uint64_t> comparisons{ 0 };
+    std::atomic<uint64_t> singleRotations{ 0 };
+    std::atomic<uint64_t> doubleRotations{ 0 };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<uint64_t> searches{ 0 };
+    std::atomic<uint64_t> searchPathTotal{ 0 };
+    std::atomic<uint64_t> searchPathMax{ 0 };
+    std::atomic<uint64_t> iteratorSteps{ 0 };
+    std::atomic<uint64_t> iteratorHops{ 0 };
+    std::atomic<uint64_t> iteratorHopsMax{ 0 };
+};
+
+// Политики учета переходов для обходов по родительским указателям (leftmostNode, inorderNext и др.):
+// IgnoreHops ничего не делает и исчезает при встраивании, CountHops прибавляет переходы к count.
+struct IgnoreHops {
+    void operator()() const {}
+};
+
+struct CountHops {
+    uint64_t& count;
+
+    void operator()() const {
+        count++;
+    }
+};
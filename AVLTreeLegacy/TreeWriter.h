@@ -0,0 +1,159 @@
+#pragma once
+// Потоковый вывод деревьев. Значения форматируются прямо в переиспользуемый буфер (числа - через
+// std::to_chars, без временных строк), буфер отдается потоку крупными кусками, поток сбрасывается
+// один раз в конце. Обход итеративный, поэтому вырожденное дерево не переполняет стек вызовов.
+// Вывод дерева из N элементов: N | N | H (H - высота дерева)
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Буфер вывода в поток: накапливает символы и пишет их в поток по CAPACITY байт.
+class OutputBuffer {
+public:
+    static const size_t CAPACITY = 1 << 16;
+
+    explicit OutputBuffer(std::ostream& n_out) : out(n_out), data(CAPACITY), used(0) {}
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    ~OutputBuffer() {
+        flush();
+    }
+
+    // Место под count символов (count <= CAPACITY); после записи в него нужно вызвать commit
+    char* reserve(size_t count) {
+        if (used + count > CAPACITY) {
+            flush();
+        }
+        return data.data() + used;
+    }
+
+    void commit(size_t count) {
+        used += count;
+    }
+
+    void put(char symbol) {
+        *reserve(1) = symbol;
+        used++;
+    }
+
+    // count одинаковых символов (отступы)
+    void fill(char symbol, size_t count) {
+        while (count > 0) {
+            size_t chunk = count < CAPACITY ? count : CAPACITY;
+            std::memset(reserve(chunk), symbol, chunk);
+            used += chunk;
+            count -= chunk;
+        }
+    }
+
+    void write(const char* text, size_t count) {
+        if (count > CAPACITY / 2) {
+            flush();
+            out.write(text, static_cast<std::streamsize>(count)); // Крупный кусок - мимо буфера
+            return;
+        }
+        std::memcpy(reserve(count), text, count);
+        used += count;
+    }
+
+    void write(std::string_view text) {
+        write(text.data(), text.size());
+    }
+
+    // Передача накопленного потоку (сам поток не сбрасывается)
+    void flush() {
+        if (used > 0) {
+            out.write(data.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+    }
+
+private:
+    std::ostream& out;
+    std::vector<char> data;
+    size_t used;
+};
+
+// Форматирование значения в буфер. Для своих типов специализируйте TreeFormatter<T>;
+// по умолчанию числа выводятся через std::to_chars, строки - как есть, остальное - через operator<<.
+template<typename T>
+struct TreeFormatter {
+    static void format(OutputBuffer& out, const T& value) {
+        if constexpr (std::is_same<T, char>::value) {
+            out.put(value);
+        }
+        else if constexpr (std::is_same<T, bool>::value) {
+            out.put(value ? '1' : '0');
+        }
+        else if constexpr (std::is_arithmetic<T>::value) {
+            // 64 символов хватает для любого целого и кратчайшей записи любого double
+            char* first = out.reserve(64);
+            std::to_chars_result result = std::to_chars(first, first + 64, value);
+            out.commit(static_cast<size_t>(result.ptr - first));
+        }
+        else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+            out.write(std::string_view(value));
+        }
+        else {
+            // Общий путь: переиспользуемый строковый поток на каждый поток выполнения
+            static thread_local std::ostringstream stream;
+            stream.str(std::string());
+            stream.clear();
+            stream << value;
+            out.write(stream.view());
+        }
+    }
+};
+
+// Значения поддерева root по возрастанию (LNR), каждое с последующим разделителем. N | N | H
+template<typename Node>
+void writeInOrder(OutputBuffer& out, const Node* root, char separator = ' ') {
+    using Value = std::remove_cv_t<std::remove_reference_t<decltype(root->n_data)>>;
+    std::vector<const Node*> path;
+    const Node* current = root;
+    while (current != nullptr || !path.empty()) {
+        while (current != nullptr) {
+            path.push_back(current);
+            current = current->n_left;
+        }
+        current = path.back();
+        path.pop_back();
+        TreeFormatter<Value>::format(out, current->n_data);
+        out.put(separator);
+        current = current->n_right;
+    }
+}
+
+// Дерево "лежа на боку": правое поддерево выше, узел уровня level смещен на level * indent пробелов,
+// по узлу в строке (обход RNL). N | N | H
+template<typename Node>
+void writeLayout(OutputBuffer& out, const Node* root, size_t indent) {
+    using Value = std::remove_cv_t<std::remove_reference_t<decltype(root->n_data)>>;
+    std::vector<std::pair<const Node*, size_t>> path;
+    const Node* current = root;
+    size_t level = 0;
+    while (current != nullptr || !path.empty()) {
+        while (current != nullptr) {
+            path.emplace_back(current, level);
+            current = current->n_right;
+            level++;
+        }
+        current = path.back().first;
+        level = path.back().second;
+        path.pop_back();
+        out.fill(' ', level * indent);
+        TreeFormatter<Value>::format(out, current->n_data);
+        out.put('\n');
+        current = current->n_left;
+        level++;
+    }
+}
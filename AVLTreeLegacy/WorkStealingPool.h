@@ -0,0 +1,281 @@
+#pragma once
+// Пул потоков с перехватом работы (work stealing) для параллельных алгоритмов "разделяй и властвуй".
+// У каждого потока своя очередь задач: владелец кладет и забирает задачи с конца (последняя
+// отложенная - первая выполненная), свободные потоки крадут из начала чужих очередей - там лежат
+// самые крупные поддеревья. Ожидающий поток не спит, а выполняет другие задачи.
+// Использование: pool.run([&] { ... pool.invoke(левая половина, правая половина); ... });
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    // threads - общее число потоков, включая вызывающий run (он работает наравне с остальными)
+    explicit WorkStealingPool(size_t threads = std::thread::hardware_concurrency()) : stopping(false), pending(0) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 1; i < threads; i++) {
+            threadsList.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threadsList) {
+            thread.join();
+        }
+    }
+
+    // Число потоков пула
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Выполнение body в вызывающем потоке как в потоке 0 пула: внутри body можно вызывать invoke.
+    // Одновременно работает только один run; вложенный run просто вызывает body.
+    template<typename F>
+    void run(F&& body) {
+        if (current.pool == this) {
+            body();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(runMutex);
+        Context saved = current;
+        current = Context{ this, 0 };
+        try {
+            body();
+        }
+        catch (...) {
+            current = saved;
+            throw;
+        }
+        current = saved;
+    }
+
+    // Параллельное выполнение left и right (fork-join): right откладывается в очередь потока и может быть
+    // украден, left выполняется сразу. Возврат - после завершения обоих; первое исключение пробрасывается.
+    // Вне run или в пуле из одного потока - просто left(); right().
+    template<typename L, typename R>
+    void invoke(L&& left, R&& right) {
+        if (current.pool != this || workers.size() == 1) {
+            left();
+            right();
+            return;
+        }
+        Worker& self = *workers[current.index];
+        TaskImpl<R> task(right);
+        push(self, &task);
+
+        std::exception_ptr leftError;
+        try {
+            left();
+        }
+        catch (...) {
+            leftError = std::current_exception();
+        }
+
+        if (popIf(self, &task)) {
+            task.execute();
+        }
+        else {
+            // Задачу украли: пока ее выполняют, работаем над другими
+            while (!task.done.load(std::memory_order_acquire)) {
+                if (!runOne(current.index)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        if (leftError) {
+            std::rethrow_exception(leftError);
+        }
+        if (task.error) {
+            std::rethrow_exception(task.error);
+        }
+    }
+
+    // Функция тестирования
+    static void runTests() {
+        WorkStealingPool pool(4);
+        assert(pool.size() == 4);
+
+        // Рекурсивная сумма с развилкой на каждом уровне
+        std::vector<long long> values(100000);
+        for (size_t i = 0; i < values.size(); i++) {
+            values[i] = static_cast<long long>(i);
+        }
+        long long total = 0;
+        pool.run([&] {
+            total = sumRange(pool, values.data(), values.size());
+        });
+        assert(total == 100000LL * 99999 / 2);
+
+        // Исключение из украденной или отложенной задачи доходит до вызывающего
+        try {
+            pool.run([&] {
+                pool.invoke([] {}, [] { throw std::runtime_error("task failed"); });
+            });
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+
+        // Вне run invoke выполняется последовательно
+        int order = 0;
+        pool.invoke([&] { order = order * 10 + 1; }, [&] { order = order * 10 + 2; });
+        assert(order == 12);
+
+        std::cout << "WorkStealingPool tests passed!" << std::endl;
+    }
+
+private:
+    // Задача с флагом завершения; живет в кадре стека invoke до своего выполнения
+    struct Task {
+        std::atomic<bool> done{ false };
+        std::exception_ptr error;
+
+        virtual ~Task() = default;
+        virtual void call() = 0;
+
+        void execute() {
+            try {
+                call();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            done.store(true, std::memory_order_release);
+        }
+    };
+
+    template<typename F>
+    struct TaskImpl : Task {
+        F& body;
+
+        explicit TaskImpl(F& n_body) : body(n_body) {}
+
+        void call() override {
+            body();
+        }
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    // Пул и номер потока, выполняющего код
+    struct Context {
+        WorkStealingPool* pool;
+        size_t index;
+    };
+
+    static inline thread_local Context current{ nullptr, 0 };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threadsList;
+    std::mutex runMutex;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::atomic<size_t> pending;
+
+    void push(Worker& worker, Task* task) {
+        {
+            std::lock_guard<std::mutex> lock(worker.lock);
+            worker.tasks.push_back(task);
+        }
+        pending.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // Снять task с конца своей очереди, если его еще не украли
+    bool popIf(Worker& worker, Task* task) {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        if (!worker.tasks.empty() && worker.tasks.back() == task) {
+            worker.tasks.pop_back();
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Выполнить одну задачу: свою с конца или чужую с начала. false - задач нет.
+    bool runOne(size_t index) {
+        Task* task = nullptr;
+        {
+            Worker& own = *workers[index];
+            std::lock_guard<std::mutex> lock(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t step = 1; task == nullptr && step < workers.size(); step++) {
+            Worker& victim = *workers[(index + step) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+            }
+        }
+        if (task == nullptr) {
+            return false;
+        }
+        pending.fetch_sub(1, std::memory_order_relaxed);
+        task->execute();
+        return true;
+    }
+
+    void workerLoop(size_t index) {
+        current = Context{ this, index };
+        while (true) {
+            if (runOne(index)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    static long long sumRange(WorkStealingPool& pool, const long long* values, size_t count) {
+        if (count <= 1000) {
+            long long sum = 0;
+            for (size_t i = 0; i < count; i++) {
+                sum += values[i];
+            }
+            return sum;
+        }
+        long long left = 0;
+        long long right = 0;
+        pool.invoke([&] { left = sumRange(pool, values, count / 2); },
+            [&] { right = sumRange(pool, values + count / 2, count - count / 2); });
+        return left + right;
+    }
+};